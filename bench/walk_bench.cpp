@@ -0,0 +1,98 @@
+// walk_bench.cpp
+// Times the working-tree walker against the std::filesystem walk that add and
+// status used before it. Build with -DMINTVCS_BUILD_BENCHMARKS=ON and run
+//   walk_bench [dir] [threads] [rounds]
+// Without a directory a synthetic tree is generated in a temp dir first.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/commands/walk/walk.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// 40 x 25 directories of 20 files each
+static void make_tree(const fs::path &root) {
+    for (int a = 0; a < 40; ++a) {
+        for (int b = 0; b < 25; ++b) {
+            fs::path dir = root / ("d" + to_string(a)) / ("e" + to_string(b));
+            fs::create_directories(dir);
+            for (int f = 0; f < 20; ++f) {
+                ofstream(dir / ("f" + to_string(f) + ".txt")) << a << ' ' << b << ' ' << f << '\n';
+            }
+        }
+    }
+}
+
+// The walk add and status did before walk_files
+static void filesystem_walk(const fs::path &dir, const fs::path &root, vector<string> &files) {
+    for (const auto &entry : fs::directory_iterator(dir)) {
+        fs::path relativePath = fs::relative(entry.path(), root);
+        if (entry.is_directory()) {
+            filesystem_walk(entry.path(), root, files);
+        } else if (entry.is_regular_file()) {
+            files.push_back(relativePath.generic_string());
+        }
+    }
+}
+
+// Best of rounds, in milliseconds; count is the number of files found
+static double best_ms(int rounds, size_t &count, const function<vector<string>()> &walk) {
+    double best = 0;
+    for (int i = 0; i < rounds; ++i) {
+        auto start = chrono::steady_clock::now();
+        vector<string> files = walk();
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (i == 0 || ms < best) best = ms;
+        count = files.size();
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    fs::path root;
+    bool generated = false;
+    if (argc > 1) {
+        root = argv[1];
+    } else {
+        root = fs::temp_directory_path() / ("walk_bench_" + to_string(chrono::steady_clock::now().time_since_epoch().count()));
+        make_tree(root);
+        generated = true;
+    }
+    unsigned threads = argc > 2 ? unsigned(atoi(argv[2])) : max(1u, thread::hardware_concurrency());
+    int rounds = argc > 3 ? max(1, atoi(argv[3])) : 5;
+
+    auto noIgnore = [](string_view, bool) { return false; };
+    size_t count = 0;
+
+    double fsMs = best_ms(rounds, count, [&] {
+        vector<string> files;
+        filesystem_walk(root, root, files);
+        return files;
+    });
+    cout << "std::filesystem walk  " << fsMs << " ms, " << count << " files\n";
+
+    double serialMs = best_ms(rounds, count, [&] {
+        vector<string> files;
+        walk_files(root.string(), "", noIgnore, [&](string_view path) { files.emplace_back(path); });
+        return files;
+    });
+    cout << "walk_files            " << serialMs << " ms, " << count << " files\n";
+
+    double parallelMs = best_ms(rounds, count, [&] {
+        return walk_files_parallel(root.string(), "", noIgnore, threads);
+    });
+    cout << "walk_files_parallel   " << parallelMs << " ms, " << count << " files (" << threads << " threads)\n";
+
+    if (generated) fs::remove_all(root);
+    return 0;
+}
@@ -4,173 +4,115 @@
 #include <vector>
 #include <fstream>
 #include <unordered_set>
-#include <unordered_map>
 #include <algorithm>
 #include <sstream>
+#include <deque>
 #include "../hash_object/hash_object.h"
+#include "../hash_object/work_pool.h"
+#include "../config/config.h"
+#include "../fsmonitor/fsmonitor.h"
+#include "../ignore/ignore.h"
+#include "../index/index.h"
+#include "../walk/walk.h"
 
 namespace fs = std::filesystem;
 using namespace std;
 
-unordered_set<string> readIgnoreList(const string &ignoreFile) {
-    unordered_set<string> ignores;
-    ifstream file(ignoreFile);
-    string line;
-
-    if (!file.is_open()) {
-        return ignores;
-    }
-
-    while (getline(file, line)) {
-        line.erase(0, line.find_first_not_of(" \t\r\n"));
-        line.erase(line.find_last_not_of(" \t\r\n") + 1);
-
-        if (line.empty() || line[0] == '#') continue;
-        replace(line.begin(), line.end(), '\\', '/');
-
-        if (!line.empty() && line.back() == '/')
-            line.pop_back();
-
-        ignores.insert(line);
-    }
-
-    return ignores;
-}
-
-bool isIgnored(const fs::path &relativePath, const unordered_set<string> &ignores) {
-    string relStr = relativePath.generic_string();
-
-    string firstComponent;
-    size_t slashPos = relStr.find('/');
-    if (slashPos != string::npos) {
-        firstComponent = relStr.substr(0, slashPos);
-    } else {
-        firstComponent = relStr;
-    }
-
-    if (ignores.count(firstComponent)) {
-        return true;
-    }
-    if (ignores.count(relStr)) {
-        return true;
-    }
-
-    return false;
-}
-
 string getFileMode(const fs::path &path) {
     return "100644";
 }
 
-struct IndexEntry {
+// One line of add's output, plus the hashing result for a staged file. Jobs
+// are created in walk order and reported in that order once all are done.
+struct AddJob {
+    string message;
+    bool toStderr = false;
+    bool staged = false;
+    string relStr;
     string mode;
-    string type;
-    string oid;
-    string path;
+    ObjectId oid;
+    IndexStat stat;
 };
 
-unordered_map<string, IndexEntry> readIndex(const string &indexPath) {
-    unordered_map<string, IndexEntry> entries;
-    ifstream file(indexPath);
-
-    if (!file.is_open()) {
-        return entries;
-    }
-
-    string line;
-    while (getline(file, line)) {
-        if (line.empty()) continue;
-
-        istringstream iss(line);
-        IndexEntry entry;
-
-        if (iss >> entry.mode >> entry.type >> entry.oid) {
-            getline(iss, entry.path);
-            entry.path.erase(0, entry.path.find_first_not_of(" \t"));
-
-            entries[entry.path] = entry;
-        }
-    }
-
-    return entries;
+static void note(deque<AddJob> &jobs, const string &message, bool toStderr = false) {
+    AddJob job;
+    job.message = message;
+    job.toStderr = toStderr;
+    jobs.push_back(std::move(job));
 }
 
-void writeIndex(const string &indexPath, const unordered_map<string, IndexEntry> &entries) {
-    vector<IndexEntry> sorted;
-    for (const auto &pair : entries) {
-        sorted.push_back(pair.second);
-    }
-    sort(sorted.begin(), sorted.end(),
-         [](const IndexEntry &a, const IndexEntry &b) { return a.path < b.path; });
-
-    fs::create_directories(".mintvcs");
-
-    ofstream file(indexPath);
-    if (!file.is_open()) {
-        throw runtime_error("Unable to write index file: " + indexPath);
-    }
-
-    for (const auto &entry : sorted) {
-        file << entry.mode << " " << entry.type << " " << entry.oid << " " << entry.path << "\n";
-    }
+// Queue hashing for a regular file, named relative to the repository root
+static void stageFile(const string &relStr, deque<AddJob> &jobs, WorkPool &pool) {
+    jobs.emplace_back();
+    AddJob *job = &jobs.back(); // deque elements stay put as the walk appends
+    job->relStr = relStr;
+    job->mode = getFileMode(relStr);
+
+    // Reading, SHA-1 and deflate run on the pool
+    pool.submit([job] {
+        try {
+            // stat before reading: a change during hashing then shows up as
+            // a stat mismatch on the next status instead of going unnoticed
+            if (!index_stat_file(job->relStr, job->stat)) job->stat = IndexStat();
+            job->oid = hash_object_id(job->relStr, true);
+            job->staged = true;
+            job->message = "Added: " + job->relStr + " (OID: " + job->oid.hex() + ")";
+        } catch (const exception &e) {
+            job->message = "Error adding file " + job->relStr + ": " + e.what();
+            job->toStderr = true;
+        }
+    });
 }
 
 void addFile(const fs::path &filepath,
-             unordered_map<string, IndexEntry> &indexEntries,
-             const unordered_set<string> &ignores) {
+             deque<AddJob> &jobs,
+             WorkPool &pool,
+             const IgnoreMatcher &ignores) {
 
-    fs::path relativePath = fs::relative(filepath);
-    string relStr = relativePath.generic_string();
+    string relStr = fs::relative(filepath).generic_string();
 
-    if (isIgnored(relativePath, ignores)) {
-        cerr << "Skipping ignored file: " << relStr << endl;
+    if (ignores.ignored(relStr, false)) {
+        note(jobs, "Skipping ignored file: " + relStr, true);
         return;
     }
 
     if (!fs::exists(filepath) || !fs::is_regular_file(filepath)) {
-        cerr << "Not a valid file: " << relStr << endl;
+        note(jobs, "Not a valid file: " + relStr, true);
         return;
     }
 
-    try {
-        string oid = hash_object(relStr, true);
-
-        IndexEntry entry;
-        entry.mode = getFileMode(filepath);
-        entry.type = "blob";
-        entry.oid = oid;
-        entry.path = relStr;
-
-        indexEntries[relStr] = entry;
-
-        cout << "Added: " << relStr << " (OID: " << oid << ")" << endl;
+    stageFile(relStr, jobs, pool);
+}
 
-    } catch (const exception &e) {
-        cerr << "Error adding file " << relStr << ": " << e.what() << endl;
-    }
+// With the fsmonitor daemon's changes since the index last matched the
+// working tree: whether a file still matches its entry, so staging it again
+// would change nothing
+static bool unchangedSinceIndex(const string &relStr, const Index &index, const FsmonitorChanges *changes) {
+    return changes && !changes->covers(relStr) && !index.fsmonitor().is_dirty(relStr) && index.find(relStr);
 }
 
+// The walker has already left out ignored paths and anything but regular files
 void addDirectory(const fs::path &dir,
-                  unordered_map<string, IndexEntry> &indexEntries,
-                  const unordered_set<string> &ignores,
-                  const fs::path &root) {
-
-    for (auto &entry : fs::directory_iterator(dir)) {
-        fs::path relativePath = fs::relative(entry.path(), root);
-
-        if (isIgnored(relativePath, ignores)) {
-            continue;
-        }
-
-        if (entry.is_directory()) {
-            addDirectory(entry.path(), indexEntries, ignores, root);
-        } else if (entry.is_regular_file()) {
-            addFile(entry.path(), indexEntries, ignores);
-        }
+                  deque<AddJob> &jobs,
+                  WorkPool &pool,
+                  const IgnoreMatcher &ignores,
+                  const Index &index,
+                  const FsmonitorChanges *changes) {
+
+    string prefix = fs::relative(dir).generic_string();
+    if (prefix == ".") prefix.clear();
+    if (!prefix.empty() && ignores.ignored(prefix, true)) return;
+
+    // the walk prunes ignored directories, so only the entry itself is matched
+    vector<string> files = walk_files_parallel(dir.string(), prefix, [&](string_view path, bool isDir) {
+        return ignores.matches(path, isDir);
+    }, pool.threads());
+    for (const string &relStr : files) {
+        if (!unchangedSinceIndex(relStr, index, changes)) stageFile(relStr, jobs, pool);
     }
 }
 
-void add(const vector<string> &paths) {
+void add(const vector<string> &paths, int jobCount) {
     string indexPath = ".mintvcs/index";
 
     if (!fs::exists(".mintvcs")) {
@@ -178,31 +120,58 @@ void add(const vector<string> &paths) {
         return;
     }
 
-    unordered_set<string> ignores = readIgnoreList(".mintvcsignore");
+    IgnoreMatcher ignores(ignore_read_rules(".mintvcsignore"));
 
-    unordered_map<string, IndexEntry> indexEntries = readIndex(indexPath);
+    Index index;
+    index.load(indexPath);
+    FsmonitorChanges fsmonitorChanges;
+    const FsmonitorChanges *changes =
+        !index.fsmonitor().token.empty() && fsmonitor_query(index.fsmonitor().token, fsmonitorChanges)
+            ? &fsmonitorChanges : nullptr;
 
     fs::path root = fs::current_path();
 
-    for (const string &pathStr : paths) {
-        fs::path path(pathStr);
-
-        if (pathStr == ".") {
-            cout << "Adding all files..." << endl;
-            addDirectory(root, indexEntries, ignores, root);
-        } else if (fs::is_directory(path)) {
-            cout << "Adding directory: " << pathStr << endl;
-            addDirectory(path, indexEntries, ignores, root);
-        } else if (fs::exists(path)) {
-            addFile(path, indexEntries, ignores);
-        } else {
-            cerr << "Path does not exist: " << pathStr << endl;
+    deque<AddJob> jobs;
+    {
+        WorkPool pool(resolve_job_count(jobCount));
+
+        for (const string &pathStr : paths) {
+            fs::path path(pathStr);
+
+            if (pathStr == ".") {
+                note(jobs, "Adding all files...");
+                addDirectory(root, jobs, pool, ignores, index, changes);
+            } else if (fs::is_directory(path)) {
+                note(jobs, "Adding directory: " + pathStr);
+                addDirectory(path, jobs, pool, ignores, index, changes);
+            } else if (fs::exists(path)) {
+                addFile(path, jobs, pool, ignores);
+            } else {
+                note(jobs, "Path does not exist: " + pathStr, true);
+            }
+        }
+        pool.wait();
+    }
+
+    // Single writer: results become one run merged into the index
+    vector<IndexEntry> staged;
+    for (const AddJob &job : jobs) {
+        if (job.staged) {
+            IndexEntry entry;
+            entry.mode = job.mode;
+            entry.oid = job.oid;
+            entry.path = job.relStr;
+            entry.stat = job.stat;
+            staged.push_back(std::move(entry));
         }
+        if (job.toStderr) cerr << job.message << endl;
+        else cout << job.message << endl;
     }
 
     try {
-        writeIndex(indexPath, indexEntries);
-        cout << "\nIndex updated successfully. " << indexEntries.size() << " files staged." << endl;
+        index.merge(std::move(staged));
+        index.save(indexPath);
+        cout << "\nIndex updated successfully. " << index.size() << " files staged." << endl;
     } catch (const exception &e) {
         cerr << "Error writing index: " << e.what() << endl;
     }
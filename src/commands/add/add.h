@@ -5,7 +5,8 @@
 #include <vector>
 
 // Main add function - stages files for commit
-// Accepts file paths, directory paths, or "." to add all files
-void add(const std::vector<std::string> &paths);
+// Accepts file paths, directory paths, or "." to add all files.
+// Files are hashed on jobs worker threads (0 = core.jobs / number of cores).
+void add(const std::vector<std::string> &paths, int jobs = 0);
 
 #endif
\ No newline at end of file
@@ -3,11 +3,16 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <vector>
 #include <unordered_set>
 
 #include "../hash_object/hash_object.h"
+#include "../hash_object/object_store.h"
+#include "../hash_object/tree_format.h"
+#include "../hash_object/pack.h"
+#include "../index/index.h"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -19,100 +24,48 @@ static string trim(const string &s) {
     return s.substr(start, end - start + 1);
 }
 
-static string readObject(const string &oid) {
-    fs::path objPath = fs::path(".mintvcs/objects") / oid.substr(0, 2) / oid.substr(2);
-    if (!fs::exists(objPath)) {
-        throw runtime_error("Object not found: " + oid);
-    }
-    vector<uint8_t> data = read_object_file(objPath.string());
-    vector<uint8_t> decompressed = zlib_decompress_bytes(data);
-    return string(decompressed.begin(), decompressed.end());
-}
-
-static void parseObject(const string &raw, string &type, string &content) {
-    size_t nullPos = raw.find('\0');
-    if (nullPos == string::npos) {
-        throw runtime_error("Invalid object format");
-    }
-    
-    string header = raw.substr(0, nullPos);
-    content = raw.substr(nullPos + 1);
-    
-    size_t spacePos = header.find(' ');
-    if (spacePos == string::npos) {
-        throw runtime_error("Invalid object header");
-    }
-    
-    type = header.substr(0, spacePos);
-}
-
 static string getTreeFromCommit(const string &commitOid) {
-    string raw = readObject(commitOid);
-    string type, content;
-    parseObject(raw, type, content);
-    
-    if (type != "commit") {
-        throw runtime_error("Object is not a commit: " + commitOid);
-    }
-    
-    istringstream ss(content);
-    string line;
-    while (getline(ss, line)) {
-        if (line.rfind("tree ", 0) == 0) {
-            return trim(line.substr(5));
-        }
-    }
+    ObjectRef commit = object_store_get(commitOid, "commit");
+    string_view content = commit->body();
+
+    string tree;
+    for_each_line(content, [&](string_view line) {
+        if (line.rfind("tree ", 0) != 0) return true;
+        tree = trim(string(line.substr(5)));
+        return false;
+    });
+    if (!tree.empty()) return tree;
     
     throw runtime_error("No tree found in commit");
 }
 
+// Local to this file; other commands have their own TreeEntry
+namespace {
 struct TreeEntry {
     string mode;
     string name;
-    string oid;
+    ObjectId oid;
     bool isDir;
 };
+}
+
+static vector<TreeEntry> parseTree(const ObjectId &treeOid) {
+    ObjectRef tree = object_store_get(treeOid, "tree");
 
-static vector<TreeEntry> parseTree(const string &treeOid) {
-    string raw = readObject(treeOid);
-    string type, content;
-    parseObject(raw, type, content);
-    
-    if (type != "tree") {
-        throw runtime_error("Object is not a tree: " + treeOid);
-    }
-    
     vector<TreeEntry> entries;
-    size_t pos = 0;
-    
-    while (pos < content.size()) {
-        size_t spacePos = content.find(' ', pos);
-        if (spacePos == string::npos) break;
-        string mode = content.substr(pos, spacePos - pos);
-        pos = spacePos + 1;
-        
-        size_t nullPos = content.find('\0', pos);
-        if (nullPos == string::npos) break;
-        string name = content.substr(pos, nullPos - pos);
-        pos = nullPos + 1;
-        
-        if (pos + 40 > content.size()) break;
-        string oid = content.substr(pos, 40);
-        pos += 40;
-        
+    tree_for_each_entry(tree->body(), [&](const TreeEntryView &view) {
         TreeEntry entry;
-        entry.mode = mode;
-        entry.name = name;
-        entry.oid = oid;
-        entry.isDir = (mode == "40000");
-        
-        entries.push_back(entry);
-    }
-    
+        entry.isDir = view.isDir();
+        entry.mode = string(view.mode);
+        entry.name = string(view.name);
+        entry.oid = view.oid;
+        entries.push_back(std::move(entry));
+    });
+
     return entries;
 }
 
-static void checkoutTree(const string &treeOid, const fs::path &targetPath) {
+static void checkoutTree(const ObjectId &treeOid, const fs::path &targetPath) {
     auto entries = parseTree(treeOid);
     
     for (const auto &entry : entries) {
@@ -122,21 +75,28 @@ static void checkoutTree(const string &treeOid, const fs::path &targetPath) {
             fs::create_directories(entryPath);
             checkoutTree(entry.oid, entryPath);
         } else {
-            string raw = readObject(entry.oid);
-            string type, content;
-            parseObject(raw, type, content);
-            
-            if (type != "blob") {
-                cerr << "Warning: expected blob but got " << type << " for " << entryPath << endl;
-                continue;
-            }
-            
-            ofstream outFile(entryPath, ios::binary);
-            if (!outFile) {
-                cerr << "Warning: cannot write file " << entryPath << endl;
-                continue;
-            }
-            outFile.write(content.data(), content.size());
+            // Stream the blob body straight into the working file
+            ofstream outFile;
+            bool skipped = false;
+            stream_object(entry.oid.hex(),
+                [&](const string &type, uint64_t) {
+                    if (type != "blob") {
+                        cerr << "Warning: expected blob but got " << type << " for " << entryPath << endl;
+                        skipped = true;
+                        return false;
+                    }
+                    outFile.open(entryPath, ios::binary | ios::trunc);
+                    if (!outFile) {
+                        cerr << "Warning: cannot write file " << entryPath << endl;
+                        skipped = true;
+                        return false;
+                    }
+                    return true;
+                },
+                [&](const uint8_t *data, size_t len) {
+                    outFile.write(reinterpret_cast<const char*>(data), len);
+                });
+            if (skipped) continue;
             outFile.close();
             
             cout << "Checked out: " << entryPath.generic_string() << endl;
@@ -146,29 +106,11 @@ static void checkoutTree(const string &treeOid, const fs::path &targetPath) {
 
 static unordered_set<string> getTrackedFiles() {
     unordered_set<string> tracked;
-    
-    if (!fs::exists(".mintvcs/index")) {
-        return tracked;
+    Index index;
+    index.load();
+    for (const IndexEntry &entry : index) {
+        tracked.insert(entry.path);
     }
-    
-    ifstream indexFile(".mintvcs/index");
-    string line;
-    
-    while (getline(indexFile, line)) {
-        if (line.empty()) continue;
-        
-        istringstream ss(line);
-        string mode, type, oid, path;
-        
-        if (ss >> mode >> type >> oid) {
-            getline(ss, path);
-            path = trim(path);
-            if (!path.empty()) {
-                tracked.insert(path);
-            }
-        }
-    }
-    
     return tracked;
 }
 
@@ -190,36 +132,41 @@ static void removeUntrackedFiles(const unordered_set<string> &newTracked) {
     }
 }
 
-static void updateIndex(const string &treeOid, const fs::path &prefix = "") {
+// Files were just written by checkoutTree, so their stat data is current.
+// Every tree read here is also recorded as the directory's cached tree.
+static void collectIndexEntries(const ObjectId &treeOid, const fs::path &prefix, vector<IndexEntry> &out,
+                                CachedTree &cache) {
     auto entries = parseTree(treeOid);
-    
-    static ofstream *indexFile = nullptr;
-    static bool firstCall = true;
-    
-    if (firstCall) {
-        indexFile = new ofstream(".mintvcs/index", ios::trunc);
-        if (!*indexFile) {
-            throw runtime_error("Cannot write to index file");
-        }
-        firstCall = false;
-    }
+    size_t start = out.size();
     
     for (const auto &entry : entries) {
         fs::path entryPath = prefix / entry.name;
         
         if (entry.isDir) {
-            updateIndex(entry.oid, entryPath);
+            cache.children.emplace_back();
+            cache.children.back().name = entry.name;
+            collectIndexEntries(entry.oid, entryPath, out, cache.children.back());
         } else {
-            *indexFile << entry.mode << " blob " << entry.oid << " " << entryPath.generic_string() << "\n";
+            IndexEntry indexEntry;
+            indexEntry.mode = entry.mode;
+            indexEntry.oid = entry.oid;
+            indexEntry.path = entryPath.generic_string();
+            index_stat_file(indexEntry.path, indexEntry.stat);
+            out.push_back(std::move(indexEntry));
         }
     }
-    
-    if (prefix.empty()) {
-        indexFile->close();
-        delete indexFile;
-        indexFile = nullptr;
-        firstCall = true;
-    }
+    cache.oid = treeOid;
+    cache.entryCount = int32_t(out.size() - start);
+}
+
+static void updateIndex(const ObjectId &treeOid) {
+    vector<IndexEntry> entries;
+    CachedTree cache;
+    collectIndexEntries(treeOid, "", entries, cache);
+    Index index;
+    index.merge(std::move(entries));
+    index.cache_tree() = std::move(cache);
+    index.save();
 }
 
 static string resolveReference(const string &ref) {
@@ -276,6 +223,10 @@ static string resolveReference(const string &ref) {
                 }
             }
         }
+        string packed = pack_find_prefix(refToResolve);
+        if (!packed.empty()) {
+            return packed;
+        }
     }
     
     throw runtime_error("Cannot resolve reference: " + ref);
@@ -328,7 +279,7 @@ void mintvcs_checkout(const string &target) {
             return;
         }
         
-        string treeOid = getTreeFromCommit(commitOid);
+        ObjectId treeOid = ObjectId::from_hex(getTreeFromCommit(commitOid));
         
         removeUntrackedFiles(newTrackedFiles);
         
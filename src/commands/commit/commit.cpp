@@ -13,19 +13,17 @@
 #include <memory>
 
 #include "../hash_object/hash_object.h"
+#include "../hash_object/object_presence.h"
+#include "../hash_object/tree_format.h"
+#include "../hash_object/work_pool.h"
+#include "../config/config.h"
+#include "../index/index.h"
 #include "commit.h"
 #include "../branch/branch.h"
 
 using namespace std;
 namespace fs = std::filesystem;
 
-struct IndexEntry {
-    string mode;
-    string type;
-    string sha1;
-    string path;
-};
-
 static string resolveHeadToCommit() {
     ifstream headFile(".mintvcs/HEAD");
     if (!headFile) {
@@ -77,126 +75,191 @@ static string resolveHeadToCommit() {
     return line;
 }
 
-// Read index lines robustly: read first three tokens and treat remainder as path
-vector<IndexEntry> read_index(const string &path) {
-    ifstream f(path);
-    if (!f) {
-        cerr << "Cannot open index file: " << path << endl;
-        return {};
-    }
+// compute sha1 hex for a string (treating it as bytes)
+static string sha1_hex_from_string(const string &s) {
+    return sha1_of_bytes(s.data(), s.size()).hex();
+}
 
-    vector<IndexEntry> entries;
-    string line;
-    while (getline(f, line)) {
-        if (line.empty()) continue;
-        istringstream ss(line);
-        IndexEntry e;
-        if (!(ss >> e.mode >> e.type >> e.sha1)) {
-            // malformed line, skip with warning
-            cerr << "Warning: malformed index line (ignored): " << line << endl;
-            continue;
-        }
-        string rest;
-        getline(ss, rest);
-        // trim leading spaces
-        size_t pos = rest.find_first_not_of(" \t");
-        if (pos == string::npos) {
-            cerr << "Warning: index entry missing path (ignored): " << line << endl;
-            continue;
-        }
-        e.path = rest.substr(pos);
-        entries.push_back(move(e));
-    }
-    return entries;
+// store object given oid hex and full content (header+body) -> compress & write
+static void storeObjectFull(const string &oid_hex, const string &full_content) {
+    vector<uint8_t> raw(full_content.begin(), full_content.end());
+    auto compressed = zlib_compress_bytes(raw);
+    write_object_file(oid_hex, compressed);
 }
 
-// free tree nodes recursively
-void free_tree(TreeNode* node) {
-    if (!node) return;
-    for (auto ptr : node->children) free_tree(ptr);
-    delete node;
+// Trees per write job: enough to amortise the job, and small ones are common
+static const size_t TREE_BATCH = 64;
+
+// A tree that is already stored, as most are when a subtree did not change,
+// is not deflated again
+static void storeTree(const ObjectId &oid, const string &full) {
+    if (object_presence_maybe_has(oid) && has_object(oid.hex())) return;
+    storeObjectFull(oid.hex(), full);
 }
 
-// split path by '/'
-vector<string> splitPath(const string &path) {
-    vector<string> parts;
-    string tmp;
-    stringstream ss(path);
-    while (getline(ss, tmp, '/')) {
-        if (!tmp.empty()) parts.push_back(tmp);
+// Serialize, hash and store one directory whose children all have ids
+static void writeTreeNode(TreeNode *dir) {
+    string content;
+    tree_begin(content);
+    for (auto child : dir->children()) {
+        tree_append_entry(content, child->isDir ? TREE_MODE_DIR : TREE_MODE_FILE, child->name, child->sha1);
     }
-    return parts;
+
+    string header = "tree " + to_string(content.size()) + '\0';
+    string full = header + content;
+    dir->sha1 = sha1_of_bytes(full.data(), full.size());
+    storeTree(dir->sha1, full);
 }
 
-// build tree: returns pointer to root (heap allocated). Caller responsible to free_tree(root).
-TreeNode* build_tree(const vector<IndexEntry> &entries) {
-    TreeNode* root = new TreeNode("", "", true);
-    for (const auto &e : entries) {
-        vector<string> parts = splitPath(e.path);
-        TreeNode* current = root;
-        for (size_t i = 0; i < parts.size(); ++i) {
-            const string &part = parts[i];
-            bool isLeaf = (i == parts.size() - 1);
-
-            // find existing child
-            TreeNode* next = nullptr;
-            for (auto child : current->children) {
-                if (child->name == part) {
-                    next = child;
-                    break;
-                }
-            }
+// A directory only needs the ids of those below it, so the tree is written
+// one depth at a time from the bottom up, each depth's directories in
+// parallel batches on pool.
+ObjectId computeTreeHash(TreeNode* node, WorkPool &pool) {
+    if (!node) return ObjectId();
 
-            if (!next) {
-                // create new node
-                next = new TreeNode("", part, !isLeaf);
-                current->children.push_back(next);
-            }
+    if (!node->isDir || node->cached) {
+        return node->sha1;
+    }
 
-            current = next;
-            if (isLeaf) {
-                current->sha1 = e.sha1;
-            }
+    vector<vector<TreeNode*>> levels;
+    vector<pair<TreeNode*, size_t>> pending = { { node, 0 } };
+    while (!pending.empty()) {
+        auto [dir, depth] = pending.back();
+        pending.pop_back();
+        if (levels.size() <= depth) levels.resize(depth + 1);
+        levels[depth].push_back(dir);
+        for (auto child : dir->children()) {
+            if (child->isDir && !child->cached) pending.push_back({ child, depth + 1 });
         }
     }
-    return root;
-}
 
-// compute sha1 hex for a string (treating it as bytes)
-static string sha1_hex_from_string(const string &s) {
-    vector<uint8_t> v(s.begin(), s.end());
-    return sha1_hex_of_bytes(v);
+    for (size_t depth = levels.size(); depth-- > 0;) {
+        const vector<TreeNode*> &level = levels[depth];
+        for (size_t begin = 0; begin < level.size(); begin += TREE_BATCH) {
+            size_t end = min(level.size(), begin + TREE_BATCH);
+            pool.submit([&level, begin, end] {
+                for (size_t i = begin; i < end; ++i) writeTreeNode(level[i]);
+            });
+        }
+        pool.wait();
+    }
+    return node->sha1;
 }
 
-// store object given oid hex and full content (header+body) -> compress & write
-static void storeObjectFull(const string &oid_hex, const string &full_content) {
-    vector<uint8_t> raw(full_content.begin(), full_content.end());
-    auto compressed = zlib_compress_bytes(raw);
-    write_object_file(oid_hex, compressed);
-}
+namespace {
+// Tree objects waiting to be deflated and written. Their ids are known when
+// they are queued; the writes go to the pool in batches.
+class TreeWriteQueue {
+public:
+    explicit TreeWriteQueue(WorkPool &pool) : pool_(pool) {}
 
-string computeTreeHash(TreeNode* node) {
-    if (!node) return "";
+    void add(const ObjectId &oid, string full) {
+        batch_.emplace_back(oid, std::move(full));
+        if (batch_.size() == TREE_BATCH) flush();
+    }
+    // Wait until every queued tree is stored; rethrows a write error
+    void finish() {
+        flush();
+        pool_.wait();
+    }
 
-    if (!node->isDir) {
-        return node->sha1;
+private:
+    void flush() {
+        if (batch_.empty()) return;
+        auto batch = make_shared<vector<pair<ObjectId, string>>>(std::move(batch_));
+        batch_.clear();
+        pool_.submit([batch] {
+            for (const auto &tree : *batch) storeTree(tree.first, tree.second);
+        });
     }
 
-    string content;
-    for (auto child : node->children) {
-        string childHash = computeTreeHash(child);
-        child->sha1 = childHash;
+    WorkPool &pool_;
+    vector<pair<ObjectId, string>> batch_;
+};
+}
 
-        string mode = child->isDir ? "40000" : "100644";
-        content += mode + " " + child->name + '\0' + childHash;
-    }
+static bool pathIsUnder(string_view path, const string &dir) {
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
 
-    string header = "tree " + to_string(content.size()) + '\0';
-    string full = header + content;
-    string treeHash = sha1_hex_from_string(full);
+namespace {
+// A directory whose entries are still being appended
+struct OpenTree {
+    string path;                      // "" for the root
+    CachedTree *cache = nullptr;      // its tree from an earlier commit, if any
+    string body;
+    int32_t entryCount = 0;
+    vector<CachedTree> cachedChildren;
+};
+}
+
+// Write a tree for every directory of entries, sorted by path, in one pass.
+// A directory's entries are contiguous and come in tree order, so it is
+// opened at its first entry and written as soon as an entry outside it comes
+// along, before its parent needs its id. A directory whose cached tree still
+// covers its entries is not written again. cache ends up holding the trees
+// of this commit. Trees are hashed here, as a parent needs its children's
+// ids, and written through queue.
+static ObjectId writeTrees(const vector<IndexEntry> &entries, CachedTree &cache, TreeWriteQueue &queue) {
+    if (cache.valid() && index_range_is_dir(entries, 0, cache.entryCount, "")) return cache.oid;
+
+    vector<OpenTree> open;
+    auto push = [&](string path, CachedTree *old) {
+        OpenTree &tree = open.emplace_back();
+        tree.path = std::move(path);
+        tree.cache = old;
+        tree_begin(tree.body);
+    };
+    // write the innermost directory and take it off the stack
+    auto close = [&]() {
+        OpenTree &tree = open.back();
+        string full = "tree " + to_string(tree.body.size()) + '\0' + tree.body;
+        CachedTree written;
+        written.name = tree.path.substr(tree.path.rfind('/') + 1);
+        written.entryCount = tree.entryCount;
+        written.oid = sha1_of_bytes(full.data(), full.size());
+        written.children = std::move(tree.cachedChildren);
+        queue.add(written.oid, std::move(full));
+        open.pop_back();
+        return written;
+    };
+    auto addDir = [&](CachedTree dir) {
+        OpenTree &parent = open.back();
+        tree_append_entry(parent.body, TREE_MODE_DIR, dir.name, dir.oid);
+        parent.entryCount += dir.entryCount;
+        parent.cachedChildren.push_back(std::move(dir));
+    };
+
+    push("", &cache);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        string_view path = entries[i].path;
+        while (open.size() > 1 && !pathIsUnder(path, open.back().path)) addDir(close());
+
+        // open the directories between the innermost one and the file
+        size_t start = open.back().path.empty() ? 0 : open.back().path.size() + 1;
+        bool reused = false;
+        for (size_t slash; (slash = path.find('/', start)) != string_view::npos; start = slash + 1) {
+            string_view name = path.substr(start, slash - start);
+            string dirPath(path.substr(0, slash));
+            CachedTree *old = open.back().cache ? open.back().cache->child(name) : nullptr;
+            if (old && old->valid() && index_range_is_dir(entries, i, old->entryCount, dirPath)) {
+                // nothing below changed since it was written
+                i += old->entryCount - 1;
+                addDir(std::move(*old));
+                reused = true;
+                break;
+            }
+            push(std::move(dirPath), old);
+        }
+        if (reused) continue;
 
-    storeObjectFull(treeHash, full);
-    return treeHash;
+        OpenTree &dir = open.back();
+        tree_append_entry(dir.body, TREE_MODE_FILE, path.substr(start), entries[i].oid);
+        ++dir.entryCount;
+    }
+    while (open.size() > 1) addDir(close());
+    cache = close();
+    return cache.oid;
 }
 
 string createCommitObject(const string &treeHash, vector<string>& parentHash, const string &message) {
@@ -274,23 +337,26 @@ int mintvcs_commit(const string &message) {
             return 1;
         }
 
-        auto entries = read_index(index_path.string());
-        if (entries.empty()) {
+        Index index;
+        index.load(index_path.string());
+        if (index.empty()) {
             cerr << "Index empty. Nothing to commit.\n";
             return 1;
         }
-        sort(entries.begin(), entries.end(), [](const IndexEntry &a, const IndexEntry &b){
-            return a.path < b.path;
-        });
 
-        TreeNode* root = build_tree(entries);
-        if (!root) {
-            cerr << "Failed to build tree\n";
-            return 1;
+        // entries come back sorted by path
+        WorkPool pool(resolve_job_count(0));
+        TreeWriteQueue queue(pool);
+        string root_tree_oid = writeTrees(index.entries(), index.cache_tree(), queue).hex();
+        queue.finish();
+
+        // Keep the trees for the next commit; losing them only costs time
+        try {
+            index.save(index_path.string());
+        } catch (const exception &e) {
+            cerr << "Warning: could not update index: " << e.what() << "\n";
         }
 
-        string root_tree_oid = computeTreeHash(root);
-
         string parent = resolveHeadToCommit();
         string branch = "main";
         if(parent!=""){
@@ -313,8 +379,6 @@ int mintvcs_commit(const string &message) {
 
         cout << "Created commit " << commit_oid << "\n";
 
-        free_tree(root);
-
         return 0;
     } catch (const exception &ex) {
         cerr << "commit failed: " << ex.what() << "\n";
@@ -3,22 +3,15 @@
 
 #include <string>
 #include <vector>
+#include "../hash_object/object_id.h"
+#include "tree_arena.h"
+#include "../hash_object/work_pool.h"
 using namespace std;
 
-struct TreeNode {
-    string sha1;
-    string name;
-    bool isDir;
-    vector<TreeNode*> children;
-
-    TreeNode(): sha1(""), name(""), isDir(false) {}
-    TreeNode(const string &sha, const string &n, bool dir): sha1(sha), name(n), isDir(dir) {}
-};
-
-
 void commit(const string& message);
 static void storeObjectFull(const string &oid_hex, const string &full_content);
-string computeTreeHash(class TreeNode* node);
+// Writes every tree object below node, on pool's threads
+ObjectId computeTreeHash(TreeNode* node, WorkPool &pool);
 string createCommitObject(const string &treeHash, vector<string> &parentHash, const string &message);
 void updateHead(const string &hash, const string &branch);
 
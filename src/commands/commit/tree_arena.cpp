@@ -0,0 +1,59 @@
+#include "tree_arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+using namespace std;
+
+// Big enough that a tree of a few hundred thousand entries takes a few
+// hundred blocks
+static const size_t BLOCK_SIZE = 256 * 1024;
+
+void TreeNode::append(TreeNode *child) {
+    if (lastChild) {
+        lastChild->nextSibling = child;
+    } else {
+        firstChild = child;
+    }
+    lastChild = child;
+}
+
+TreeNode *TreeNode::child(string_view childName) const {
+    for (TreeNode *c = firstChild; c; c = c->nextSibling) {
+        if (c->name == childName) return c;
+    }
+    return nullptr;
+}
+
+void *TreeArena::allocate(size_t size, size_t align) {
+    size_t pad = (align - reinterpret_cast<uintptr_t>(cursor_) % align) % align;
+    if (pad + size > left_) {
+        // an oversized request gets a block of its own
+        size_t blockSize = max(BLOCK_SIZE, size + align);
+        blocks_.emplace_back(new char[blockSize]);
+        cursor_ = blocks_.back().get();
+        left_ = blockSize;
+        pad = (align - reinterpret_cast<uintptr_t>(cursor_) % align) % align;
+    }
+    void *out = cursor_ + pad;
+    cursor_ += pad + size;
+    left_ -= pad + size;
+    return out;
+}
+
+TreeNode *TreeArena::node(const ObjectId &sha, string_view name, bool isDir) {
+    TreeNode *n = new (allocate(sizeof(TreeNode), alignof(TreeNode))) TreeNode();
+    n->sha1 = sha;
+    n->name = intern(name);
+    n->isDir = isDir;
+    return n;
+}
+
+string_view TreeArena::intern(string_view name) {
+    auto found = names_.find(name);
+    if (found != names_.end()) return *found;
+    char *copy = static_cast<char*>(allocate(name.size(), 1));
+    memcpy(copy, name.data(), name.size());
+    return *names_.insert(string_view(copy, name.size())).first;
+}
@@ -0,0 +1,71 @@
+#ifndef TREE_ARENA_H
+#define TREE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <unordered_set>
+#include <vector>
+
+#include "../hash_object/object_id.h"
+
+// A file or directory of a tree being built or read. Nodes live in a
+// TreeArena and are never freed one by one; children are a linked list in
+// insertion order.
+struct TreeNode {
+    ObjectId sha1;
+    std::string_view name;  // interned in the node's arena
+    bool isDir = false;
+    bool cached = false;    // sha1 is a reused subtree; children were not built
+    TreeNode *firstChild = nullptr;
+    TreeNode *lastChild = nullptr;
+    TreeNode *nextSibling = nullptr;
+
+    struct ChildIterator {
+        TreeNode *node;
+        TreeNode *operator*() const { return node; }
+        ChildIterator &operator++() {
+            node = node->nextSibling;
+            return *this;
+        }
+        bool operator!=(const ChildIterator &other) const { return node != other.node; }
+    };
+    struct ChildRange {
+        TreeNode *first;
+        ChildIterator begin() const { return { first }; }
+        ChildIterator end() const { return { nullptr }; }
+    };
+
+    ChildRange children() const { return { firstChild }; }
+    void append(TreeNode *child);
+    // Linear search, as directories are built up one entry at a time
+    TreeNode *child(std::string_view childName) const;
+};
+
+static_assert(std::is_trivially_destructible<TreeNode>::value, "TreeArena never runs destructors");
+
+// Owns every TreeNode of one operation (a commit, a merge) together with
+// their names. Nodes are bumped out of large blocks and names are stored
+// once however many trees use them, so building a big tree costs a handful
+// of mallocs and dropping it costs one free per block.
+class TreeArena {
+public:
+    TreeArena() = default;
+    TreeArena(const TreeArena &) = delete;
+    TreeArena &operator=(const TreeArena &) = delete;
+
+    TreeNode *node(const ObjectId &sha, std::string_view name, bool isDir);
+    // A copy of name that lives as long as the arena
+    std::string_view intern(std::string_view name);
+
+private:
+    void *allocate(size_t size, size_t align);
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char *cursor_ = nullptr;
+    size_t left_ = 0;
+    std::unordered_set<std::string_view> names_;
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "config.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <thread>
+
+using namespace std;
+
+static string trim(const string &s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static string lower(string s) {
+    transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return char(tolower(c)); });
+    return s;
+}
+
+string config_get(const string &key, const string &fallback) {
+    ifstream file(".mintvcs/config");
+    if (!file) return fallback;
+
+    string wanted = lower(key);
+    string section;
+    string value = fallback;
+    string line;
+    while (getline(file, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';') continue;
+        if (line[0] == '[') {
+            size_t close = line.find(']');
+            section = lower(trim(line.substr(1, close == string::npos ? string::npos : close - 1)));
+            continue;
+        }
+        size_t eq = line.find('=');
+        string name = lower(trim(line.substr(0, eq)));
+        if (section + "." + name == wanted) {
+            // later entries win, as in git
+            value = eq == string::npos ? "true" : trim(line.substr(eq + 1));
+        }
+    }
+    return value;
+}
+
+int config_get_int(const string &key, int fallback) {
+    string value = config_get(key);
+    if (value.empty()) return fallback;
+    char *end;
+    long parsed = strtol(value.c_str(), &end, 10);
+    if (end == value.c_str() || *end != '\0') return fallback;
+    return int(parsed);
+}
+
+bool config_get_bool(const string &key, bool fallback) {
+    string value = lower(config_get(key));
+    if (value == "true" || value == "yes" || value == "on" || value == "1") return true;
+    if (value == "false" || value == "no" || value == "off" || value == "0") return false;
+    return fallback;
+}
+
+unsigned resolve_job_count(int requested) {
+    if (requested > 0) return unsigned(requested);
+    int configured = config_get_int("core.jobs", 0);
+    if (configured > 0) return unsigned(configured);
+    unsigned cores = thread::hardware_concurrency();
+    return cores ? cores : 1;
+}
@@ -0,0 +1,19 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <string>
+
+// Read a value from .mintvcs/config, written by init in git's INI style:
+//   [core]
+//       jobs = 8
+// Keys are "section.name" (case-insensitive); returns fallback if unset.
+std::string config_get(const std::string &key, const std::string &fallback = "");
+int config_get_int(const std::string &key, int fallback);
+// true/yes/on/1 and false/no/off/0, in any case
+bool config_get_bool(const std::string &key, bool fallback);
+
+// Worker threads for commands that run in parallel: an explicit -j value if
+// given (> 0), else core.jobs from the config, else the number of cores.
+unsigned resolve_job_count(int requested);
+
+#endif
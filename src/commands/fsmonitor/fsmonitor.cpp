@@ -0,0 +1,432 @@
+#include "fsmonitor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "../walk/walk.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char SOCKET_PATH[] = ".mintvcs/fsmonitor.sock";
+static const char META_DIR[] = ".mintvcs";
+static const char COOKIE_PREFIX[] = "fsmonitor-cookie-";
+
+bool FsmonitorChanges::covers(string_view path) const {
+    auto has = [&](string_view p) {
+        return binary_search(paths.begin(), paths.end(), p, [](string_view a, string_view b) { return a < b; });
+    };
+    for (size_t slash = path.find('/'); slash != string_view::npos; slash = path.find('/', slash + 1)) {
+        if (has(path.substr(0, slash))) return true;
+    }
+    return has(path);
+}
+
+#ifdef __linux__
+
+// How long a client waits for an answer, and the daemon for its cookie
+static const int CLIENT_TIMEOUT_SEC = 10;
+static const int COOKIE_TIMEOUT_MS = 5000;
+// Past this many remembered paths the daemon forgets them all and answers
+// older tokens with "full"
+static const size_t MAX_CHANGED_PATHS = 1000000;
+
+static const uint32_t WATCH_MASK = IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                   IN_ONLYDIR;
+
+static bool socket_address(sockaddr_un &addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (sizeof(SOCKET_PATH) > sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, SOCKET_PATH, sizeof(SOCKET_PATH));
+    return true;
+}
+
+static bool send_all(int fd, const string &data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += size_t(n);
+    }
+    return true;
+}
+
+// Send one request line and read the whole answer
+static bool request(const string &line, string &reply) {
+    sockaddr_un addr;
+    if (!socket_address(addr)) return false;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    timeval timeout = { CLIENT_TIMEOUT_SEC, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || !send_all(fd, line + "\n")) {
+        close(fd);
+        return false;
+    }
+    shutdown(fd, SHUT_WR);
+
+    reply.clear();
+    char buffer[64 * 1024];
+    bool ok = true;
+    while (true) {
+        ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) ok = false;
+        if (n <= 0) break;
+        reply.append(buffer, size_t(n));
+    }
+    close(fd);
+    return ok;
+}
+
+bool fsmonitor_query(const string &token, FsmonitorChanges &out) {
+    out = FsmonitorChanges();
+    string reply;
+    if (!request("query " + token, reply)) return false;
+
+    vector<string> fields;
+    size_t start = 0;
+    for (size_t nul = reply.find('\0'); nul != string::npos; nul = reply.find('\0', start)) {
+        fields.emplace_back(reply, start, nul - start);
+        start = nul + 1;
+    }
+    if (fields.size() < 2 || start != reply.size()) return false;
+    out.token = fields[0];
+    if (fields[1] != "since") return false;
+    out.paths.assign(fields.begin() + 2, fields.end());
+    sort(out.paths.begin(), out.paths.end());
+    return true;
+}
+
+// ----------------- Daemon -----------------
+
+namespace {
+
+class Monitor {
+public:
+    ~Monitor();
+
+    // Watch the working tree and listen on the socket; false after printing
+    // why not
+    bool start();
+    // Answer clients until asked to quit
+    void serve();
+
+private:
+    void watchDir(const string &path);
+    void watchTree(const string &dir);
+    void dropWatchesBelow(const string &dir);
+    void record(const string &path);
+    // Handle pending events; sets cookieSeen when cookie's event is among them
+    void readEvents(const string &cookie, bool &cookieSeen);
+    void handleEvent(const inotify_event &event, const string &cookie, bool &cookieSeen);
+    // Wait until every change made before now has been read
+    bool flush();
+    string token() const;
+    string answer(const string &line, bool &quit);
+
+    int inotifyFd_ = -1;
+    int listenFd_ = -1;
+    int metaWd_ = -1;
+    unordered_map<int, string> watches_;     // watch descriptor -> directory
+    unordered_map<string, uint64_t> changed_; // path -> sequence number of its last change
+    uint64_t sequence_ = 0;
+    uint64_t lostBefore_ = 0;  // tokens older than this get "full"
+    bool incomplete_ = false;  // some directory is not watched
+    string instance_;
+    unsigned cookies_ = 0;
+};
+
+}
+
+Monitor::~Monitor() {
+    if (inotifyFd_ >= 0) close(inotifyFd_);
+    if (listenFd_ >= 0) close(listenFd_);
+}
+
+void Monitor::watchDir(const string &path) {
+    int wd = inotify_add_watch(inotifyFd_, path.empty() ? "." : path.c_str(), WATCH_MASK);
+    if (wd >= 0) {
+        watches_[wd] = path;
+    } else if (errno != ENOENT && errno != ENOTDIR) {
+        // out of watches, most likely: fs.inotify.max_user_watches
+        incomplete_ = true;
+    }
+}
+
+// Watch dir and every directory below it. A watch is in place before its
+// directory is listed, so nothing created meanwhile goes unseen.
+void Monitor::watchTree(const string &dir) {
+    watchDir(dir);
+    walk_files(dir, dir, [&](string_view path, bool isDir) {
+        if (!isDir) return false;
+        if (path == META_DIR) return true;
+        watchDir(string(path));
+        return false;
+    }, [](string_view) {});
+}
+
+void Monitor::dropWatchesBelow(const string &dir) {
+    for (auto it = watches_.begin(); it != watches_.end();) {
+        const string &path = it->second;
+        if (path.compare(0, dir.size(), dir) == 0 && (path.size() == dir.size() || path[dir.size()] == '/')) {
+            inotify_rm_watch(inotifyFd_, it->first);
+            it = watches_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Monitor::record(const string &path) {
+    if (changed_.size() >= MAX_CHANGED_PATHS) {
+        changed_.clear();
+        lostBefore_ = sequence_ + 1;
+    }
+    changed_[path] = ++sequence_;
+}
+
+void Monitor::handleEvent(const inotify_event &event, const string &cookie, bool &cookieSeen) {
+    if (event.mask & IN_Q_OVERFLOW) {
+        changed_.clear();
+        lostBefore_ = ++sequence_;
+        return;
+    }
+    if (event.wd == metaWd_) {
+        if (event.len && cookie == event.name) cookieSeen = true;
+        return;
+    }
+    auto found = watches_.find(event.wd);
+    if (found == watches_.end()) return;
+    if (event.mask & IN_IGNORED) {
+        watches_.erase(found);
+        return;
+    }
+    // a directory's own events also reach its parent's watch, by name
+    if (!event.len) return;
+
+    string path = found->second;
+    if (!path.empty()) path += '/';
+    path += event.name;
+    if (path == META_DIR) return;
+
+    if (event.mask & IN_ISDIR) {
+        // only what is in a directory matters, not its own metadata
+        if (!(event.mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) return;
+        if (event.mask & (IN_DELETE | IN_MOVED_FROM)) dropWatchesBelow(path);
+        if (event.mask & (IN_CREATE | IN_MOVED_TO)) watchTree(path);
+    }
+    record(path);
+}
+
+void Monitor::readEvents(const string &cookie, bool &cookieSeen) {
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t n = read(inotifyFd_, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        for (ssize_t offset = 0; offset < n;) {
+            const inotify_event *event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            handleEvent(*event, cookie, cookieSeen);
+            offset += ssize_t(sizeof(inotify_event) + event->len);
+        }
+    }
+}
+
+// Events are queued in the order things happened, so once the event for a
+// cookie created now has been read, so have those of every earlier change
+bool Monitor::flush() {
+    string cookie = COOKIE_PREFIX + to_string(getpid()) + "-" + to_string(++cookies_);
+    string path = string(META_DIR) + "/" + cookie;
+    int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    close(fd);
+
+    bool seen = false;
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(COOKIE_TIMEOUT_MS);
+    while (!seen) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+        pollfd poller = { inotifyFd_, POLLIN, 0 };
+        if (left <= 0 || poll(&poller, 1, int(left)) <= 0) break;
+        readEvents(cookie, seen);
+    }
+    unlink(path.c_str());
+    return seen;
+}
+
+string Monitor::token() const {
+    return instance_ + ":" + to_string(sequence_);
+}
+
+string Monitor::answer(const string &line, bool &quit) {
+    if (line == "ping") return "watching " + to_string(watches_.size()) + " directories\n";
+    if (line == "quit") {
+        quit = true;
+        return "stopped\n";
+    }
+    if (line.rfind("query ", 0) != 0) return "";
+
+    // "<instance>:<sequence>" from this daemon, else everything is new
+    string since = line.substr(6);
+    size_t colon = since.rfind(':');
+    bool known = colon != string::npos && since.compare(0, colon, instance_) == 0;
+    uint64_t sequence = known ? strtoull(since.c_str() + colon + 1, nullptr, 10) : 0;
+
+    bool flushed = flush();
+    string reply = token();
+    reply += '\0';
+    if (!flushed || incomplete_ || !known || sequence < lostBefore_ || sequence > sequence_) {
+        reply += "full";
+        reply += '\0';
+        return reply;
+    }
+    reply += "since";
+    reply += '\0';
+    for (const auto &change : changed_) {
+        if (change.second <= sequence) continue;
+        reply += change.first;
+        reply += '\0';
+    }
+    return reply;
+}
+
+bool Monitor::start() {
+    instance_ = to_string(getpid()) + "-" +
+                to_string(chrono::system_clock::now().time_since_epoch().count());
+
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ < 0) {
+        cerr << "Error: cannot start inotify: " << strerror(errno) << endl;
+        return false;
+    }
+    metaWd_ = inotify_add_watch(inotifyFd_, META_DIR, IN_CREATE | IN_ONLYDIR);
+    if (metaWd_ < 0) {
+        cerr << "Error: cannot watch " << META_DIR << ": " << strerror(errno) << endl;
+        return false;
+    }
+    watchTree("");
+    if (incomplete_) {
+        cerr << "Warning: not every directory could be watched (raise fs.inotify.max_user_watches);"
+             << " status will scan everything" << endl;
+    }
+
+    sockaddr_un addr;
+    if (!socket_address(addr)) return false;
+    listenFd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    // a daemon that died leaves its socket behind
+    unlink(SOCKET_PATH);
+    if (listenFd_ < 0 || bind(listenFd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listenFd_, 16) != 0) {
+        cerr << "Error: cannot listen on " << SOCKET_PATH << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+void Monitor::serve() {
+    bool quit = false;
+    while (!quit) {
+        pollfd fds[2] = { { inotifyFd_, POLLIN, 0 }, { listenFd_, POLLIN, 0 } };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            bool unused = false;
+            readEvents("", unused);
+        }
+        if (!(fds[1].revents & POLLIN)) continue;
+
+        int client = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) continue;
+        timeval timeout = { CLIENT_TIMEOUT_SEC, 0 };
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        string line;
+        char c;
+        while (recv(client, &c, 1, 0) == 1 && c != '\n') line += c;
+        send_all(client, answer(line, quit));
+        close(client);
+    }
+    unlink(SOCKET_PATH);
+}
+
+int mintvcs_fsmonitor(const string &action) {
+    string reply;
+    if (action == "status") {
+        if (!request("ping", reply)) {
+            cout << "fsmonitor is not running" << endl;
+            return 1;
+        }
+        cout << "fsmonitor is " << reply;
+        return 0;
+    }
+    if (action == "stop") {
+        if (!request("quit", reply)) {
+            cout << "fsmonitor is not running" << endl;
+            return 1;
+        }
+        cout << "fsmonitor " << reply;
+        return 0;
+    }
+    if (action != "start" && action != "run") {
+        cout << "Usage: mintvcs fsmonitor <start|run|stop|status>" << endl;
+        return 1;
+    }
+    if (request("ping", reply)) {
+        cout << "fsmonitor is already running" << endl;
+        return 0;
+    }
+
+    // Watches and socket are set up before start returns, so a status run
+    // right after it can already query the daemon
+    Monitor monitor;
+    if (!monitor.start()) return 1;
+    if (action == "start") {
+        pid_t pid = fork();
+        if (pid < 0) {
+            cerr << "Error: cannot start fsmonitor: " << strerror(errno) << endl;
+            return 1;
+        }
+        if (pid > 0) {
+            cout << "fsmonitor started (pid " << pid << ")" << endl;
+            return 0;
+        }
+        setsid();
+        int devNull = open("/dev/null", O_RDWR);
+        if (devNull >= 0) {
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+            if (devNull > STDERR_FILENO) close(devNull);
+        }
+    }
+    monitor.serve();
+    return 0;
+}
+
+#else
+
+bool fsmonitor_query(const string &, FsmonitorChanges &out) {
+    out = FsmonitorChanges();
+    return false;
+}
+
+int mintvcs_fsmonitor(const string &) {
+    cerr << "Error: fsmonitor is only supported on Linux" << endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef FSMONITOR_H
+#define FSMONITOR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// `mintvcs fsmonitor start` leaves a daemon behind that holds inotify watches
+// on every directory of the working tree and numbers each change it sees.
+// Commands ask it, over the Unix socket .mintvcs/fsmonitor.sock, what changed
+// since a token they saved earlier and get back the changed paths plus a new
+// token, so they only need to look at those paths.
+//
+// Protocol: the client sends one line, "query <token>", "ping" or "quit", and
+// reads until the daemon closes the connection. A query is answered with
+//   new token | NUL | "since" or "full" | NUL | changed paths, each NUL-terminated
+// "full" means the token is unknown or changes were lost (the kernel queue
+// overflowed, or a directory could not be watched), and the caller has to
+// look at everything.
+//
+// Before answering, the daemon creates a cookie file in .mintvcs and waits
+// for its event, so every change made before the query is in the answer.
+//
+// Only Linux has a daemon; elsewhere queries always fail.
+
+// Paths changed since a token
+struct FsmonitorChanges {
+    std::string token;               // for the next query
+    std::vector<std::string> paths;  // sorted
+
+    // Whether path, or a directory above it, is among the changed paths. A
+    // changed directory stands for everything below it.
+    bool covers(std::string_view path) const;
+};
+
+// Ask a running daemon what changed since token. False if there is no daemon,
+// it cannot answer, or the answer is "full"; out.token is then still set when
+// the daemon gave one, so the caller can check everything and record it.
+bool fsmonitor_query(const std::string &token, FsmonitorChanges &out);
+
+// `mintvcs fsmonitor <start|run|stop|status>`; returns the exit code
+int mintvcs_fsmonitor(const std::string &action);
+
+#endif
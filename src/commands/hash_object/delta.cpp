@@ -0,0 +1,174 @@
+// delta.cpp
+#include "delta.h"
+
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+// Matches are found on 16-byte blocks of the base
+static const size_t DELTA_BLOCK = 16;
+static const size_t MAX_INSERT = 127;
+static const size_t MAX_COPY = 0xFFFFFF;
+
+static void put_varint(vector<uint8_t> &out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(uint8_t(v));
+}
+
+static uint64_t get_varint(const uint8_t *&p, const uint8_t *end) {
+    uint64_t v = 0;
+    int shift = 0;
+    while (true) {
+        if (p >= end || shift > 63) throw runtime_error("delta: truncated size");
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return v;
+        shift += 7;
+    }
+}
+
+static inline uint32_t block_hash(const uint8_t *p) {
+    uint64_t a, b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    uint64_t h = (a * 0x9E3779B97F4A7C15ULL) ^ (b * 0xC2B2AE3D27D4EB4FULL);
+    return uint32_t(h >> 32) ^ uint32_t(h);
+}
+
+static void emit_insert(vector<uint8_t> &out, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t n = len < MAX_INSERT ? len : MAX_INSERT;
+        out.push_back(uint8_t(n));
+        out.insert(out.end(), data, data + n);
+        data += n;
+        len -= n;
+    }
+}
+
+static void emit_copy(vector<uint8_t> &out, uint64_t offset, size_t len) {
+    while (len > 0) {
+        size_t n = len < MAX_COPY ? len : MAX_COPY;
+        uint8_t cmd = 0x80;
+        uint8_t args[7];
+        int nargs = 0;
+        for (int i = 0; i < 4; ++i) {
+            uint8_t byte = uint8_t(offset >> (8 * i));
+            if (byte) { cmd |= uint8_t(1 << i); args[nargs++] = byte; }
+        }
+        for (int i = 0; i < 3; ++i) {
+            uint8_t byte = uint8_t(n >> (8 * i));
+            if (byte) { cmd |= uint8_t(0x10 << i); args[nargs++] = byte; }
+        }
+        out.push_back(cmd);
+        out.insert(out.end(), args, args + nargs);
+        offset += n;
+        len -= n;
+    }
+}
+
+vector<uint8_t> delta_create(const uint8_t *base, size_t baseLen,
+                             const uint8_t *target, size_t targetLen,
+                             size_t maxDeltaSize) {
+    vector<uint8_t> out;
+    // copy offsets are 32-bit
+    if (baseLen < DELTA_BLOCK || baseLen > 0xFFFFFFFFULL) return out;
+
+    put_varint(out, baseLen);
+    put_varint(out, targetLen);
+
+    // One slot per hash bucket holding (block offset + 1); later blocks win
+    size_t blocks = baseLen / DELTA_BLOCK;
+    size_t tableSize = 1;
+    while (tableSize < blocks * 2) tableSize <<= 1;
+    vector<uint32_t> table(tableSize, 0);
+    for (size_t i = 0; i < blocks; ++i) {
+        size_t off = i * DELTA_BLOCK;
+        table[block_hash(base + off) & (tableSize - 1)] = uint32_t(off + 1);
+    }
+
+    size_t literalStart = 0;
+    size_t pos = 0;
+    while (pos + DELTA_BLOCK <= targetLen) {
+        uint32_t slot = table[block_hash(target + pos) & (tableSize - 1)];
+        if (slot == 0 || memcmp(base + (slot - 1), target + pos, DELTA_BLOCK) != 0) {
+            ++pos;
+            continue;
+        }
+
+        size_t matchBase = slot - 1;
+        size_t matchTarget = pos;
+        size_t len = DELTA_BLOCK;
+        while (matchBase + len < baseLen && matchTarget + len < targetLen &&
+               base[matchBase + len] == target[matchTarget + len])
+            ++len;
+        // grow backwards into the pending literal run
+        while (matchTarget > literalStart && matchBase > 0 &&
+               base[matchBase - 1] == target[matchTarget - 1]) {
+            --matchBase;
+            --matchTarget;
+            ++len;
+        }
+
+        emit_insert(out, target + literalStart, matchTarget - literalStart);
+        emit_copy(out, matchBase, len);
+        pos = matchTarget + len;
+        literalStart = pos;
+
+        if (out.size() > maxDeltaSize) return vector<uint8_t>();
+    }
+    emit_insert(out, target + literalStart, targetLen - literalStart);
+
+    if (out.size() > maxDeltaSize) return vector<uint8_t>();
+    return out;
+}
+
+vector<uint8_t> delta_apply(const uint8_t *base, size_t baseLen,
+                            const uint8_t *delta, size_t deltaLen) {
+    const uint8_t *p = delta;
+    const uint8_t *end = delta + deltaLen;
+
+    uint64_t expectBase = get_varint(p, end);
+    uint64_t resultSize = get_varint(p, end);
+    if (expectBase != baseLen) throw runtime_error("delta: base size mismatch");
+
+    vector<uint8_t> out(static_cast<size_t>(resultSize));
+    size_t o = 0;
+    while (p < end) {
+        uint8_t cmd = *p++;
+        if (cmd & 0x80) {
+            uint64_t offset = 0;
+            size_t size = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (cmd & (1 << i)) {
+                    if (p >= end) throw runtime_error("delta: truncated copy");
+                    offset |= uint64_t(*p++) << (8 * i);
+                }
+            }
+            for (int i = 0; i < 3; ++i) {
+                if (cmd & (0x10 << i)) {
+                    if (p >= end) throw runtime_error("delta: truncated copy");
+                    size |= size_t(*p++) << (8 * i);
+                }
+            }
+            if (size == 0) size = 0x10000;
+            if (offset + size > baseLen || size > out.size() - o)
+                throw runtime_error("delta: copy out of range");
+            memcpy(out.data() + o, base + offset, size);
+            o += size;
+        } else if (cmd) {
+            if (size_t(end - p) < cmd || cmd > out.size() - o)
+                throw runtime_error("delta: insert out of range");
+            memcpy(out.data() + o, p, cmd);
+            p += cmd;
+            o += cmd;
+        } else {
+            throw runtime_error("delta: invalid opcode");
+        }
+    }
+    if (o != out.size()) throw runtime_error("delta: result size mismatch");
+    return out;
+}
@@ -0,0 +1,25 @@
+// delta.h
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Delta format: varint base size | varint result size | instructions
+//   copy:   1xxxxxxx, then the offset bytes flagged by bits 0-3 and the size
+//           bytes flagged by bits 4-6 (little-endian; size 0 means 0x10000)
+//   insert: 0nnnnnnn (n = 1..127), then n literal bytes
+// Varints are little-endian base-128.
+
+// Encode target as copy/insert instructions against base. Returns an empty
+// vector if the delta would be larger than maxDeltaSize.
+std::vector<uint8_t> delta_create(const uint8_t *base, size_t baseLen,
+                                  const uint8_t *target, size_t targetLen,
+                                  size_t maxDeltaSize);
+
+// Rebuild the target from base and a delta; throws on a malformed delta.
+std::vector<uint8_t> delta_apply(const uint8_t *base, size_t baseLen,
+                                 const uint8_t *delta, size_t deltaLen);
+
+#endif
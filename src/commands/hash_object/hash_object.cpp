@@ -7,130 +7,28 @@
 #include <string>
 #include <vector>
 #include <array>
-#include <iomanip>
+#include <atomic>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <zlib.h>
 #include <string.h>
 
+#include "sha1.h"
+#include "mapped_file.h"
+#include "object_presence.h"
+#include "pack.h"
+#include "hash_object.h"
+
 
 using namespace std;
 namespace fs = std::filesystem;
 
-// Minimal, public-domain SHA-1 implementation (small, self-contained).
-// Provides: void sha1_init(...), sha1_update(...), sha1_final(...)
-// This is a straightforward reference implementation suitable for small projects.
-struct SHA1_CTX {
-    uint32_t state[5];
-    uint64_t count;
-    uint8_t buffer[64];
-};
-
-static inline uint32_t rol(uint32_t value, unsigned int bits) {
-    return (value << bits) | (value >> (32 - bits));
-}
-
-void sha1_transform(uint32_t state[5], const uint8_t buffer[64]) {
-    uint32_t w[80];
-    for (int i = 0; i < 16; ++i) {
-        w[i] = (uint32_t(buffer[i*4]) << 24) |
-               (uint32_t(buffer[i*4+1]) << 16) |
-               (uint32_t(buffer[i*4+2]) << 8) |
-               (uint32_t(buffer[i*4+3]));
-    }
-    for (int i = 16; i < 80; ++i)
-        w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
-
-    uint32_t a = state[0];
-    uint32_t b = state[1];
-    uint32_t c = state[2];
-    uint32_t d = state[3];
-    uint32_t e = state[4];
-
-    for (int i = 0; i < 80; ++i) {
-        uint32_t f, k;
-        if (i < 20) {
-            f = (b & c) | ((~b) & d);
-            k = 0x5A827999;
-        } else if (i < 40) {
-            f = b ^ c ^ d;
-            k = 0x6ED9EBA1;
-        } else if (i < 60) {
-            f = (b & c) | (b & d) | (c & d);
-            k = 0x8F1BBCDC;
-        } else {
-            f = b ^ c ^ d;
-            k = 0xCA62C1D6;
-        }
-        uint32_t temp = rol(a,5) + f + e + k + w[i];
-        e = d;
-        d = c;
-        c = rol(b,30);
-        b = a;
-        a = temp;
-    }
-
-    state[0] += a;
-    state[1] += b;
-    state[2] += c;
-    state[3] += d;
-    state[4] += e;
-}
-
-void sha1_init(SHA1_CTX &ctx) {
-    ctx.state[0] = 0x67452301;
-    ctx.state[1] = 0xEFCDAB89;
-    ctx.state[2] = 0x98BADCFE;
-    ctx.state[3] = 0x10325476;
-    ctx.state[4] = 0xC3D2E1F0;
-    ctx.count = 0;
-    memset(ctx.buffer, 0, sizeof(ctx.buffer));
-}
-
-void sha1_update(SHA1_CTX &ctx, const uint8_t *data, size_t len) {
-    size_t i = 0;
-    size_t idx = (ctx.count >> 3) & 0x3F;
-    ctx.count += static_cast<uint64_t>(len) << 3;
-
-    if (idx) {
-        size_t fill = 64 - idx;
-        if (len >= fill) {
-            memcpy(ctx.buffer + idx, data, fill);
-            sha1_transform(ctx.state, ctx.buffer);
-            i += fill;
-            idx = 0;
-        } else {
-            memcpy(ctx.buffer + idx, data, len);
-            return;
-        }
-    }
-
-    for (; i + 63 < len; i += 64)
-        sha1_transform(ctx.state, data + i);
-
-    if (i < len)
-        memcpy(ctx.buffer, data + i, len - i);
-}
-
-void sha1_final(SHA1_CTX &ctx, uint8_t digest[20]) {
-    uint8_t padding[64] = { 0x80 };
-    uint8_t bits[8];
-    uint64_t cnt = ctx.count;
-    for (int i = 0; i < 8; ++i) {
-        bits[7 - i] = static_cast<uint8_t>(cnt & 0xff);
-        cnt >>= 8;
-    }
-
-    size_t idx = (ctx.count >> 3) & 0x3F;
-    size_t padLen = (idx < 56) ? (56 - idx) : (120 - idx);
-    sha1_update(ctx, padding, padLen);
-    sha1_update(ctx, bits, 8);
-
-    for (int i = 0; i < 5; ++i) {
-        digest[i*4]     = static_cast<uint8_t>((ctx.state[i] >> 24) & 0xff);
-        digest[i*4 + 1] = static_cast<uint8_t>((ctx.state[i] >> 16) & 0xff);
-        digest[i*4 + 2] = static_cast<uint8_t>((ctx.state[i] >> 8) & 0xff);
-        digest[i*4 + 3] = static_cast<uint8_t>((ctx.state[i]) & 0xff);
-    }
-}
+// Read/deflate granularity for the streaming hash-object path
+static const size_t HASH_CHUNK_SIZE = 64 * 1024;
 
 // Read entire file into vector<uint8_t>
 vector<uint8_t> read_file_bytes(const string &path) {
@@ -163,18 +61,17 @@ vector<uint8_t> build_blob_store(const vector<uint8_t> &content) {
 
 // Compute SHA-1 digest of data vector and return 40-char hex OID
 string sha1_hex_of_bytes(const vector<uint8_t> &data) {
+    return sha1_of_bytes(data.data(), data.size()).hex();
+}
+
+ObjectId sha1_of_bytes(const void *data, size_t len) {
     SHA1_CTX ctx;
     sha1_init(ctx);
-    if (!data.empty())
-        sha1_update(ctx, data.data(), data.size());
-    uint8_t digest[20];
-    sha1_final(ctx, digest);
-
-    ostringstream oss;
-    oss << hex << setfill('0');
-    for (int i = 0; i < 20; ++i)
-        oss << setw(2) << static_cast<int>(digest[i]);
-    return oss.str();
+    if (len > 0)
+        sha1_update(ctx, static_cast<const uint8_t*>(data), len);
+    ObjectId id;
+    sha1_final(ctx, id.bytes);
+    return id;
 }
 
 // Compress bytes using zlib compress(); returns compressed vector
@@ -189,58 +86,435 @@ vector<uint8_t> zlib_compress_bytes(const vector<uint8_t> &in) {
     return out;
 }
 
-// NEW: Decompress bytes using zlib uncompress(); returns decompressed vector
+// Largest possible "<type> <size>\0" header: "commit " + 20 digits + NUL
+static const size_t MAX_OBJECT_HEADER = 32;
+
+// Parse "<type> <size>\0" from the start of buf; returns false if no complete
+// header. Like git, a size with a leading zero or one that does not fit in
+// 64 bits is rejected rather than read as some other number.
+static bool parse_object_header(const uint8_t *buf, size_t len,
+                                size_t &headerLen, string &type, uint64_t &size) {
+    const uint8_t *nul = static_cast<const uint8_t*>(memchr(buf, '\0', len));
+    if (!nul) return false;
+    const uint8_t *space = static_cast<const uint8_t*>(memchr(buf, ' ', nul - buf));
+    if (!space || space == buf || space + 1 == nul) return false;
+    if (space[1] == '0' && space + 2 != nul) return false;
+
+    uint64_t value = 0;
+    for (const uint8_t *p = space + 1; p < nul; ++p) {
+        if (*p < '0' || *p > '9') return false;
+        uint64_t digit = *p - '0';
+        if (value > (numeric_limits<uint64_t>::max() - digit) / 10) return false;
+        value = value * 10 + digit;
+    }
+
+    type.assign(reinterpret_cast<const char*>(buf), space - buf);
+    size = value;
+    headerLen = static_cast<size_t>(nul - buf) + 1;
+    return true;
+}
+
+// Inflates a compressed object in one pass. The header is inflated into a small
+// buffer first, so the body size is known before any large buffer is allocated.
+class ObjectInflater {
+public:
+    ObjectInflater(const uint8_t *in, size_t len) {
+        memset(&zs_, 0, sizeof(zs_));
+        if (inflateInit(&zs_) != Z_OK) throw runtime_error("zlib inflateInit failed");
+        zs_.next_in = const_cast<Bytef*>(in);
+        inEnd_ = in + len;
+        readHeader();
+    }
+
+    ~ObjectInflater() { inflateEnd(&zs_); }
+
+    ObjectInflater(const ObjectInflater &) = delete;
+    ObjectInflater &operator=(const ObjectInflater &) = delete;
+
+    const string &type() const { return type_; }
+    uint64_t size() const { return size_; }
+    size_t headerLen() const { return headerLen_; }
+    const uint8_t *header() const { return head_; }
+    uint64_t remaining() const { return size_ - consumed_; }
+
+    // Inflate exactly n body bytes into dst
+    void readExact(uint8_t *dst, size_t n) {
+        if (n > remaining()) throw runtime_error("zlib inflate: read past object size");
+        consumed_ += n;
+
+        size_t fromHead = min(n, headAvail_ - headPos_);
+        if (fromHead) {
+            memcpy(dst, head_ + headPos_, fromHead);
+            headPos_ += fromHead;
+            dst += fromHead;
+            n -= fromHead;
+        }
+
+        while (n > 0) {
+            if (ended_) throw runtime_error("zlib inflate: object shorter than its header size");
+            uInt step = static_cast<uInt>(min<size_t>(n, numeric_limits<uInt>::max()));
+            zs_.next_out = dst;
+            zs_.avail_out = step;
+            int res = step_inflate(Z_NO_FLUSH);
+            size_t got = step - zs_.avail_out;
+            dst += got;
+            n -= got;
+            checkResult(res, got);
+        }
+    }
+
+    // After the whole body was read, the zlib stream must end right here
+    void expectEnd() {
+        if (remaining() != 0 || headPos_ != headAvail_)
+            throw runtime_error("zlib inflate: object longer than its header size");
+        if (ended_) return;
+        uint8_t extra;
+        zs_.next_out = &extra;
+        zs_.avail_out = 1;
+        int res = step_inflate(Z_FINISH);
+        if (res != Z_STREAM_END || zs_.avail_out == 0)
+            throw runtime_error("zlib inflate: object longer than its header size");
+        ended_ = true;
+    }
+
+private:
+    void readHeader() {
+        while (true) {
+            zs_.next_out = head_ + headAvail_;
+            zs_.avail_out = static_cast<uInt>(sizeof(head_) - headAvail_);
+            int res = step_inflate(Z_NO_FLUSH);
+            size_t got = sizeof(head_) - headAvail_ - zs_.avail_out;
+            headAvail_ += got;
+
+            if (parse_object_header(head_, headAvail_, headerLen_, type_, size_)) break;
+            if (headAvail_ == sizeof(head_) || res == Z_STREAM_END)
+                throw runtime_error("Invalid object header");
+            checkResult(res, got);
+        }
+        headPos_ = headerLen_;
+        if (headAvail_ - headPos_ > size_)
+            throw runtime_error("zlib inflate: object longer than its header size");
+    }
+
+    // zlib counts input in uInt, so large inputs are fed in slices
+    int step_inflate(int flush) {
+        if (zs_.avail_in == 0) {
+            size_t left = static_cast<size_t>(inEnd_ - zs_.next_in);
+            zs_.avail_in = static_cast<uInt>(min<size_t>(left, numeric_limits<uInt>::max()));
+        }
+        return inflate(&zs_, flush);
+    }
+
+    void checkResult(int res, size_t got) {
+        if (res == Z_STREAM_END) {
+            ended_ = true;
+        } else if (res == Z_BUF_ERROR && got == 0) {
+            throw runtime_error("zlib inflate failed: truncated object");
+        } else if (res != Z_OK && res != Z_BUF_ERROR) {
+            throw runtime_error("zlib inflate failed with error code: " + to_string(res));
+        }
+    }
+
+    z_stream zs_;
+    const uint8_t *inEnd_ = nullptr;
+    uint8_t head_[MAX_OBJECT_HEADER];
+    size_t headAvail_ = 0;
+    size_t headPos_ = 0;
+    size_t headerLen_ = 0;
+    string type_;
+    uint64_t size_ = 0;
+    uint64_t consumed_ = 0;
+    bool ended_ = false;
+};
+
+// Inflate a whole object ("<type> <size>\0<body>") into one exact-size allocation
+static vector<uint8_t> inflate_whole(const uint8_t *in, size_t len, size_t &typeLen, size_t &headerLen) {
+    ObjectInflater inf(in, len);
+    if (inf.size() > numeric_limits<size_t>::max() - inf.headerLen())
+        throw runtime_error("Object too large: " + to_string(inf.size()) + " bytes");
+    vector<uint8_t> out(inf.headerLen() + inf.size());
+    memcpy(out.data(), inf.header(), inf.headerLen());
+    inf.readExact(out.data() + inf.headerLen(), inf.size());
+    inf.expectEnd();
+    typeLen = inf.type().size();
+    headerLen = inf.headerLen();
+    return out;
+}
+
 vector<uint8_t> zlib_decompress_bytes(const vector<uint8_t> &in) {
-    // Start with a reasonable buffer size (e.g., 10x the compressed size)
-    uLong dest_len = in.size() * 10;
-    vector<uint8_t> out;
-    
-    // Try decompressing with increasingly larger buffers if needed
-    for (int attempt = 0; attempt < 3; ++attempt) {
-        out.resize(dest_len);
-        int res = uncompress(out.data(), &dest_len, 
-                           in.empty() ? nullptr : in.data(), 
-                           static_cast<uLong>(in.size()));
-        
-        if (res == Z_OK) {
-            out.resize(dest_len);
-            return out;
-        } else if (res == Z_BUF_ERROR) {
-            // Buffer too small, try again with larger buffer
-            dest_len *= 2;
-        } else {
-            throw runtime_error("zlib uncompress failed with error code: " + to_string(res));
+    return zlib_decompress_bytes(in.data(), in.size());
+}
+
+vector<uint8_t> zlib_decompress_bytes(const uint8_t *in, size_t len) {
+    size_t typeLen, headerLen;
+    return inflate_whole(in, len, typeLen, headerLen);
+}
+
+string object_path(const string &oid_hex) {
+    if (oid_hex.size() < 3) throw runtime_error("Invalid object id: " + oid_hex);
+    string path = ".mintvcs/objects/";
+    path.append(oid_hex, 0, 2);
+    path += '/';
+    path.append(oid_hex, 2, string::npos);
+    return path;
+}
+
+// Compressed bytes of an object from a pack or a loose file. The view stays
+// valid while `loose` (or the process-wide pack mapping) is alive. A packed
+// delta is returned as-is in `delta` with data left null.
+static bool find_compressed_object(const string &oid_hex, MappedFile &loose,
+                                   const uint8_t *&data, size_t &len, PackedEntry &delta) {
+    PackedEntry packed;
+    data = nullptr;
+    if (pack_find_object(oid_hex, packed)) {
+        if (packed.kind == PACK_ENTRY_DELTA) {
+            delta = packed;
+            return true;
         }
+        if (packed.kind != PACK_ENTRY_FULL)
+            throw runtime_error("Unsupported pack entry kind for object " + oid_hex);
+        data = packed.data;
+        len = packed.size;
+        return true;
+    }
+    if (!loose.open(object_path(oid_hex))) return false;
+    data = loose.data();
+    len = loose.size();
+    return true;
+}
+
+bool has_object(const string &oid_hex) {
+    if (pack_has_object(oid_hex)) return true;
+    error_code ec;
+    return fs::exists(object_path(oid_hex), ec);
+}
+
+// Rebuild a packed delta and locate its "<type> <size>\0" header
+static vector<uint8_t> resolve_packed_object(const string &oid_hex, const PackedEntry &delta,
+                                             string &type, size_t &headerLen) {
+    vector<uint8_t> raw = pack_resolve_delta(delta);
+    uint64_t size;
+    if (!parse_object_header(raw.data(), min(raw.size(), MAX_OBJECT_HEADER), headerLen, type, size) ||
+        size != raw.size() - headerLen)
+        throw runtime_error("Corrupt object header in packed delta " + oid_hex);
+    return raw;
+}
+
+ObjectHandle read_object(const string &oid_hex) {
+    MappedFile loose;
+    const uint8_t *data;
+    size_t len;
+    PackedEntry delta;
+    if (!find_compressed_object(oid_hex, loose, data, len, delta))
+        throw runtime_error("Object not found: " + oid_hex);
+
+    size_t typeLen, headerLen;
+    if (!data) {
+        string type;
+        vector<uint8_t> raw = resolve_packed_object(oid_hex, delta, type, headerLen);
+        return ObjectHandle(std::move(raw), type.size(), headerLen);
     }
-    
-    throw runtime_error("zlib uncompress failed: buffer size insufficient after multiple attempts");
+    vector<uint8_t> raw = inflate_whole(data, len, typeLen, headerLen);
+    return ObjectHandle(std::move(raw), typeLen, headerLen);
+}
+
+void stream_object(const string &oid_hex,
+                   const function<bool(const string &type, uint64_t size)> &onHeader,
+                   const function<void(const uint8_t *data, size_t len)> &onData) {
+    MappedFile loose;
+    const uint8_t *data;
+    size_t len;
+    PackedEntry delta;
+    if (!find_compressed_object(oid_hex, loose, data, len, delta))
+        throw runtime_error("Object not found: " + oid_hex);
+    if (!data) {
+        string type;
+        size_t headerLen;
+        vector<uint8_t> raw = resolve_packed_object(oid_hex, delta, type, headerLen);
+        if (onHeader(type, raw.size() - headerLen) && raw.size() > headerLen)
+            onData(raw.data() + headerLen, raw.size() - headerLen);
+        return;
+    }
+    inflate_object(data, len, onHeader, onData);
+}
+
+void inflate_object(const uint8_t *in, size_t len,
+                    const function<bool(const string &type, uint64_t size)> &onHeader,
+                    const function<void(const uint8_t *data, size_t len)> &onData) {
+    ObjectInflater inf(in, len);
+    if (!onHeader(inf.type(), inf.size())) return;
+
+    vector<uint8_t> chunk(static_cast<size_t>(min<uint64_t>(inf.size(), HASH_CHUNK_SIZE)));
+    while (inf.remaining() > 0) {
+        size_t n = static_cast<size_t>(min<uint64_t>(inf.remaining(), chunk.size()));
+        inf.readExact(chunk.data(), n);
+        onData(chunk.data(), n);
+    }
+    inf.expectEnd();
+}
+
+// A fresh name for an object being written in dir; the seed keeps
+// concurrent processes apart and the counter keeps threads apart
+static fs::path make_temp_path(const fs::path &dir) {
+    static atomic<uint64_t> counter{0};
+    static const uint64_t seed = (uint64_t(random_device{}()) << 32) ^ random_device{}();
+    ostringstream name;
+    name << "tmp_obj_" << hex << seed << "_" << counter.fetch_add(1);
+    return dir / name.str();
 }
 
 // Write compressed object into .mintvcs/objects/xx/yyyy... ; skip if exists
+// The presence filter answers "never stored" without touching the disk; only
+// a possible hit pays for the stat calls. A stale filter or a concurrent
+// writer can still get here for an object that exists, so the bytes go to a
+// temp file in the fan-out dir and are renamed over the final path: readers
+// see the old file or the new one, both complete and identical.
 void write_object_file(const string &oid_hex, const vector<uint8_t> &compressed) {
-    string dir = ".mintvcs/objects/" + oid_hex.substr(0,2);
-    string filename = oid_hex.substr(2);
-    fs::path dpath(dir);
-    fs::create_directories(dpath);
-    fs::path fpath = dpath / filename;
+    ObjectId oid = ObjectId::from_hex(oid_hex);
+    fs::path fpath = object_path(oid_hex);
 
-    if (fs::exists(fpath)) return; // do not overwrite existing object
+    if (object_presence_maybe_has(oid) && (fs::exists(fpath) || pack_has_object(oid_hex)))
+        return; // do not overwrite existing object
+    object_presence_ensure_fanout_dir(oid);
 
-    ofstream ofs(fpath, ios::binary);
-    if (!ofs) throw runtime_error("Unable to write object file: " + fpath.string());
-    ofs.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    fs::path tmp = make_temp_path(fpath.parent_path());
+    ofstream ofs(tmp, ios::binary | ios::trunc);
+    if (ofs) {
+        ofs.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+        ofs.close();
+    }
+    error_code ec;
+    if (ofs) fs::rename(tmp, fpath, ec);
+    if (!ofs || ec) {
+        error_code ignored;
+        fs::remove(tmp, ignored);
+        throw runtime_error("Unable to write object file: " + fpath.string());
+    }
+    object_presence_add(oid);
 }
 
+// Deflates a stream of bytes into a temporary file under .mintvcs/objects and
+// renames it to its final loose-object path once the OID is known. The temp
+// file is removed if the object is never committed (e.g. on error).
+class LooseObjectWriter {
+public:
+    LooseObjectWriter() : out_(HASH_CHUNK_SIZE) {
+        static once_flag objectsDir;
+        call_once(objectsDir, [] { fs::create_directories(".mintvcs/objects"); });
+        tmpPath_ = make_temp_path(".mintvcs/objects");
+        ofs_.open(tmpPath_, ios::binary | ios::trunc);
+        if (!ofs_) throw runtime_error("Unable to create temp object: " + tmpPath_.string());
+
+        memset(&zs_, 0, sizeof(zs_));
+        if (deflateInit(&zs_, Z_DEFAULT_COMPRESSION) != Z_OK)
+            throw runtime_error("zlib deflateInit failed");
+        zsOpen_ = true;
+    }
+
+    ~LooseObjectWriter() {
+        if (zsOpen_) deflateEnd(&zs_);
+        if (ofs_.is_open()) ofs_.close();
+        if (!committed_) {
+            error_code ec;
+            fs::remove(tmpPath_, ec);
+        }
+    }
+
+    LooseObjectWriter(const LooseObjectWriter &) = delete;
+    LooseObjectWriter &operator=(const LooseObjectWriter &) = delete;
+
+    void write(const uint8_t *data, size_t len) {
+        zs_.next_in = const_cast<Bytef*>(data);
+        zs_.avail_in = static_cast<uInt>(len);
+        pump(Z_NO_FLUSH);
+    }
+
+    // Finish the deflate stream and move the temp file into place.
+    void commit(const ObjectId &oid) {
+        zs_.next_in = nullptr;
+        zs_.avail_in = 0;
+        pump(Z_FINISH);
+        deflateEnd(&zs_);
+        zsOpen_ = false;
+
+        ofs_.close();
+        if (!ofs_) throw runtime_error("Unable to write temp object: " + tmpPath_.string());
+
+        string oid_hex = oid.hex();
+        fs::path fpath = object_path(oid_hex);
+
+        // do not overwrite existing object; temp is dropped
+        if (object_presence_maybe_has(oid) && (fs::exists(fpath) || pack_has_object(oid_hex))) return;
+
+        object_presence_ensure_fanout_dir(oid);
+        fs::rename(tmpPath_, fpath);
+        committed_ = true;
+        object_presence_add(oid);
+    }
+
+private:
+    void pump(int flush) {
+        int res;
+        do {
+            zs_.next_out = out_.data();
+            zs_.avail_out = static_cast<uInt>(out_.size());
+            res = deflate(&zs_, flush);
+            if (res == Z_STREAM_ERROR) throw runtime_error("zlib deflate failed");
+            size_t have = out_.size() - zs_.avail_out;
+            if (have) ofs_.write(reinterpret_cast<const char*>(out_.data()), have);
+        } while (zs_.avail_out == 0 || (flush == Z_FINISH && res != Z_STREAM_END));
+        if (!ofs_) throw runtime_error("Unable to write temp object: " + tmpPath_.string());
+    }
+
+    fs::path tmpPath_;
+    ofstream ofs_;
+    z_stream zs_;
+    bool zsOpen_ = false;
+    bool committed_ = false;
+    vector<uint8_t> out_;
+};
+
 // main hash-object function
+// Streams the file in fixed-size chunks through SHA-1 and, when writing,
+// through deflate into a temp object, so memory use does not grow with file size.
 string hash_object(const string &filepath, bool write) {
-    vector<uint8_t> content = read_file_bytes(filepath);
-    vector<uint8_t> store = build_blob_store(content);
-    string oid = sha1_hex_of_bytes(store);
+    return hash_object_id(filepath, write).hex();
+}
+
+ObjectId hash_object_id(const string &filepath, bool write) {
+    ifstream ifs(filepath, ios::binary);
+    if (!ifs) throw runtime_error("Unable to open file: " + filepath);
 
+    uint64_t size = fs::file_size(filepath);
+    string header = "blob " + to_string(size) + '\0';
+
+    SHA1_CTX ctx;
+    sha1_init(ctx);
+    sha1_update(ctx, reinterpret_cast<const uint8_t*>(header.data()), header.size());
+
+    unique_ptr<LooseObjectWriter> writer;
     if (write) {
-        vector<uint8_t> compressed = zlib_compress_bytes(store);
-        write_object_file(oid, compressed);
+        writer.reset(new LooseObjectWriter());
+        writer->write(reinterpret_cast<const uint8_t*>(header.data()), header.size());
+    }
+
+    vector<uint8_t> chunk(HASH_CHUNK_SIZE);
+    uint64_t total = 0;
+    while (ifs) {
+        ifs.read(reinterpret_cast<char*>(chunk.data()), chunk.size());
+        size_t got = static_cast<size_t>(ifs.gcount());
+        if (got == 0) break;
+        total += got;
+        if (total > size) break;
+        sha1_update(ctx, chunk.data(), got);
+        if (writer) writer->write(chunk.data(), got);
     }
+    if (total != size) throw runtime_error("File changed while hashing: " + filepath);
+
+    ObjectId oid;
+    sha1_final(ctx, oid.bytes);
+
+    if (writer) writer->commit(oid);
 
     return oid;
-}
\ No newline at end of file
+}
@@ -3,15 +3,75 @@
 #define HASH_OBJECT_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <cstdint>
+#include <functional>
+
+#include "object_id.h"
+
+// Inflated object held in one buffer; type() and body() are views into it.
+class ObjectHandle {
+public:
+    ObjectHandle() = default;
+    ObjectHandle(std::vector<uint8_t> raw, size_t typeLen, size_t headerLen)
+        : raw_(std::move(raw)), typeLen_(typeLen), headerLen_(headerLen) {}
+
+    std::string_view type() const {
+        return std::string_view(reinterpret_cast<const char*>(raw_.data()), typeLen_);
+    }
+    std::string_view body() const {
+        return std::string_view(reinterpret_cast<const char*>(raw_.data()) + headerLen_,
+                                raw_.size() - headerLen_);
+    }
+    // Header and body, exactly as stored before compression
+    std::string_view raw() const {
+        return std::string_view(reinterpret_cast<const char*>(raw_.data()), raw_.size());
+    }
+
+private:
+    std::vector<uint8_t> raw_;
+    size_t typeLen_ = 0;
+    size_t headerLen_ = 0;
+};
+
+// Calls fn with each line of text, without its '\n', until fn returns false.
+// A last line with no '\n' counts too.
+template <typename Fn>
+void for_each_line(std::string_view text, Fn fn) {
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t eol = text.find('\n', pos);
+        if (eol == std::string_view::npos) eol = text.size();
+        if (!fn(text.substr(pos, eol - pos))) return;
+        pos = eol + 1;
+    }
+}
 
 std::string hash_object(const std::string &filepath, bool write);
+ObjectId hash_object_id(const std::string &filepath, bool write);
 std::vector<uint8_t> read_file_bytes(const std::string &path);
 std::vector<uint8_t> read_object_file(const std::string &path);
 std::vector<uint8_t> zlib_compress_bytes(const std::vector<uint8_t> &in);
 std::vector<uint8_t> zlib_decompress_bytes(const std::vector<uint8_t> &in);
+std::vector<uint8_t> zlib_decompress_bytes(const uint8_t *in, size_t len);
+// Inflate an object incrementally: onHeader gets the type and body size (return
+// false to skip the body), then onData receives the body in chunks.
+void inflate_object(const uint8_t *in, size_t len,
+                    const std::function<bool(const std::string &type, uint64_t size)> &onHeader,
+                    const std::function<void(const uint8_t *data, size_t len)> &onData);
+// ".mintvcs/objects/xx/yyyy..." for a 40-char hex OID
+std::string object_path(const std::string &oid_hex);
+// Find an object in a pack or as a loose file and inflate it straight from
+// the mapping; throws if missing.
+ObjectHandle read_object(const std::string &oid_hex);
+// Same lookup as read_object, streaming the body like inflate_object
+void stream_object(const std::string &oid_hex,
+                   const std::function<bool(const std::string &type, uint64_t size)> &onHeader,
+                   const std::function<void(const uint8_t *data, size_t len)> &onData);
+bool has_object(const std::string &oid_hex);
 void write_object_file(const std::string &oid_hex, const std::vector<uint8_t> &compressed);
 std::string sha1_hex_of_bytes(const std::vector<uint8_t> &data);
+ObjectId sha1_of_bytes(const void *data, size_t len);
 
 #endif
\ No newline at end of file
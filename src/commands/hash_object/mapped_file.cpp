@@ -0,0 +1,101 @@
+// mapped_file.cpp
+#include "mapped_file.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        data_ = other.data_;
+        size_ = other.size_;
+#ifdef _WIN32
+        buffer_ = std::move(other.buffer_);
+#else
+        mapped_ = other.mapped_;
+        other.mapped_ = false;
+#endif
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const string &path) {
+    close();
+    ifstream ifs(path, ios::binary);
+    if (!ifs) return false;
+    ifs.seekg(0, ios::end);
+    streamoff size = ifs.tellg();
+    ifs.seekg(0, ios::beg);
+    buffer_.resize(static_cast<size_t>(size));
+    if (size > 0 && !ifs.read(reinterpret_cast<char*>(buffer_.data()), size))
+        throw runtime_error("Unable to read file: " + path);
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+    return true;
+}
+
+void MappedFile::close() {
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const string &path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw runtime_error("Unable to stat file: " + path);
+    }
+
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+        void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            size_ = 0;
+            throw runtime_error("Unable to map file: " + path);
+        }
+        data_ = static_cast<const uint8_t*>(addr);
+        mapped_ = true;
+    }
+    ::close(fd); // the mapping stays valid after the descriptor is closed
+    return true;
+}
+
+void MappedFile::close() {
+    if (mapped_) munmap(const_cast<uint8_t*>(data_), size_);
+    mapped_ = false;
+    data_ = nullptr;
+    size_ = 0;
+}
+
+#endif
@@ -0,0 +1,125 @@
+// object_id.cpp
+#include "object_id.h"
+
+#include <stdexcept>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MINTVCS_HEX_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+// -1 for non-hex characters
+static const int8_t *hex_table() {
+    static int8_t table[256];
+    static bool ready = [] {
+        memset(table, -1, sizeof(table));
+        for (int i = 0; i < 10; ++i) table['0' + i] = int8_t(i);
+        for (int i = 0; i < 6; ++i) {
+            table['a' + i] = int8_t(10 + i);
+            table['A' + i] = int8_t(10 + i);
+        }
+        return true;
+    }();
+    (void)ready;
+    return table;
+}
+
+static void hex_encode_scalar(const uint8_t *in, size_t n, char *out) {
+    for (size_t i = 0; i < n; ++i) {
+        out[2 * i] = HEX_DIGITS[in[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[in[i] & 0xf];
+    }
+}
+
+static bool hex_decode_scalar(const char *in, size_t n, uint8_t *out) {
+    const int8_t *table = hex_table();
+    for (size_t i = 0; i < n; ++i) {
+        int hi = table[uint8_t(in[2 * i])], lo = table[uint8_t(in[2 * i + 1])];
+        if (hi < 0 || lo < 0) return false;
+        out[i] = uint8_t((hi << 4) | lo);
+    }
+    return true;
+}
+
+#ifdef MINTVCS_HEX_X86
+
+// 16 bytes -> 32 chars per step: split nibbles, map them through a pshufb
+// table, then interleave high and low digits
+__attribute__((target("ssse3")))
+static void hex_encode_ssse3(const uint8_t *in, size_t n, char *out) {
+    const __m128i digits = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS));
+    const __m128i low4 = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(v, 4), low4));
+        __m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(v, low4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    hex_encode_scalar(in + i, n - i, out + 2 * i);
+}
+
+// Nibble values of 16 hex characters; sets bad to non-zero lanes on invalid input
+__attribute__((target("ssse3")))
+static inline __m128i hex_nibbles_ssse3(__m128i c, __m128i &bad) {
+    const __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    const __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                          _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    const __m128i isLetter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                           _mm_cmplt_epi8(lower, _mm_set1_epi8('f' + 1)));
+    bad = _mm_or_si128(bad, _mm_andnot_si128(_mm_or_si128(isDigit, isLetter), _mm_set1_epi8(-1)));
+    __m128i digit = _mm_and_si128(isDigit, _mm_sub_epi8(c, _mm_set1_epi8('0')));
+    __m128i letter = _mm_and_si128(isLetter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10)));
+    return _mm_or_si128(digit, letter);
+}
+
+// 32 chars -> 16 bytes per step; pmaddubsw folds each (hi, lo) pair into hi*16 + lo
+__attribute__((target("ssse3")))
+static bool hex_decode_ssse3(const char *in, size_t n, uint8_t *out) {
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i bad = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = hex_nibbles_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), bad);
+        __m128i b = hex_nibbles_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16)), bad);
+        __m128i packed = _mm_packus_epi16(_mm_maddubs_epi16(a, weights), _mm_maddubs_epi16(b, weights));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), packed);
+    }
+    if (_mm_movemask_epi8(bad)) return false;
+    return hex_decode_scalar(in + 2 * i, n - i, out + i);
+}
+
+static bool has_ssse3() {
+    static const bool supported = __builtin_cpu_supports("ssse3");
+    return supported;
+}
+
+#endif // MINTVCS_HEX_X86
+
+void hex_encode(const uint8_t *in, size_t n, char *out) {
+#ifdef MINTVCS_HEX_X86
+    if (n >= 16 && has_ssse3()) {
+        hex_encode_ssse3(in, n, out);
+        return;
+    }
+#endif
+    hex_encode_scalar(in, n, out);
+}
+
+bool hex_decode(const char *in, size_t n, uint8_t *out) {
+#ifdef MINTVCS_HEX_X86
+    if (n >= 16 && has_ssse3()) return hex_decode_ssse3(in, n, out);
+#endif
+    return hex_decode_scalar(in, n, out);
+}
+
+ObjectId ObjectId::from_hex(string_view hex) {
+    ObjectId id;
+    if (!parse(hex, id)) throw runtime_error("Invalid object id: " + string(hex));
+    return id;
+}
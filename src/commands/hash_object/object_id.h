@@ -0,0 +1,64 @@
+// object_id.h
+#ifndef OBJECT_ID_H
+#define OBJECT_ID_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Lower-case hex of n bytes into out[2n]
+void hex_encode(const uint8_t *in, size_t n, char *out);
+// Parse 2n hex characters (either case) into out[n]; false on any non-hex character
+bool hex_decode(const char *in, size_t n, uint8_t *out);
+
+// A raw 20-byte SHA-1 object id. Trivially copyable; the all-zero id means
+// "no object".
+struct ObjectId {
+    uint8_t bytes[20];
+
+    ObjectId() { memset(bytes, 0, sizeof(bytes)); }
+    explicit ObjectId(const uint8_t raw[20]) { memcpy(bytes, raw, sizeof(bytes)); }
+
+    // Parse a 40-char hex id; false (and out unchanged) if hex is not one
+    static bool parse(std::string_view hex, ObjectId &out) {
+        ObjectId id;
+        if (hex.size() != 40 || !hex_decode(hex.data(), 20, id.bytes)) return false;
+        out = id;
+        return true;
+    }
+    // Same, but throws std::runtime_error on a malformed id
+    static ObjectId from_hex(std::string_view hex);
+
+    std::string hex() const {
+        std::string out(40, '0');
+        hex_encode(bytes, 20, &out[0]);
+        return out;
+    }
+
+    bool is_null() const {
+        static const uint8_t zero[20] = { 0 };
+        return memcmp(bytes, zero, 20) == 0;
+    }
+
+    bool operator==(const ObjectId &o) const { return memcmp(bytes, o.bytes, 20) == 0; }
+    bool operator!=(const ObjectId &o) const { return !(*this == o); }
+    bool operator<(const ObjectId &o) const { return memcmp(bytes, o.bytes, 20) < 0; }
+};
+
+// SHA-1 output is uniform, so the leading bytes already make a good hash
+struct ObjectIdHash {
+    size_t operator()(const ObjectId &id) const {
+        size_t h;
+        memcpy(&h, id.bytes, sizeof(h));
+        return h;
+    }
+};
+
+namespace std {
+template <> struct hash<ObjectId> : ObjectIdHash {};
+}
+
+#endif
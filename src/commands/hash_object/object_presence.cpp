@@ -0,0 +1,239 @@
+// object_presence.cpp
+#include "object_presence.h"
+#include "pack.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const fs::path OBJECTS_DIR = ".mintvcs/objects";
+static const fs::path PRESENCE_PATH = ".mintvcs/objects/info/presence";
+static const char PRESENCE_MAGIC[4] = { 'M', 'B', 'L', 'M' };
+static const uint32_t PRESENCE_VERSION = 1;
+
+// ~1% false positives at 10 bits per object with 7 probes
+static const uint64_t BITS_PER_OBJECT = 10;
+static const uint32_t PROBES = 7;
+static const uint64_t MIN_OBJECTS = 4096;
+
+static void put_u32(vector<uint8_t> &out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(uint8_t(v >> shift));
+}
+
+static void put_u64(vector<uint8_t> &out, uint64_t v) {
+    put_u32(out, uint32_t(v >> 32));
+    put_u32(out, uint32_t(v));
+}
+
+static uint64_t get_be(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+static bool is_hex_name(const string &s, size_t len) {
+    if (s.size() != len) return false;
+    for (char c : s) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return true;
+}
+
+class PresenceFilter {
+public:
+    bool maybeHas(const ObjectId &oid) {
+        lock_guard<mutex> lock(mutex_);
+        load();
+        uint64_t h1, h2;
+        hashes(oid, h1, h2);
+        for (uint32_t i = 0; i < PROBES; ++i) {
+            uint64_t bit = (h1 + i * h2) % nbits_;
+            if (!(bits_[bit >> 3] & (1u << (bit & 7)))) return false;
+        }
+        return true;
+    }
+
+    void add(const ObjectId &oid) {
+        lock_guard<mutex> lock(mutex_);
+        load();
+        if (count_ + 1 > nbits_ / BITS_PER_OBJECT) {
+            // Full: rebuild at twice the size from what is on disk, which
+            // already includes this object
+            rebuild(count_ * 2);
+            return;
+        }
+        setBits(oid);
+        ++count_;
+        markDirty();
+    }
+
+    void ensureFanoutDir(const ObjectId &oid) {
+        uint8_t b = oid.bytes[0];
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (knownDirs_[b]) return;
+        }
+        char name[3];
+        hex_encode(&b, 1, name);
+        name[2] = '\0';
+        fs::create_directories(OBJECTS_DIR / name);
+        lock_guard<mutex> lock(mutex_);
+        knownDirs_[b] = true;
+    }
+
+    void save() {
+        lock_guard<mutex> lock(mutex_);
+        if (!dirty_) return;
+        dirty_ = false;
+
+        vector<uint8_t> out(PRESENCE_MAGIC, PRESENCE_MAGIC + 4);
+        put_u32(out, PRESENCE_VERSION);
+        put_u32(out, PROBES);
+        put_u64(out, nbits_);
+        put_u64(out, count_);
+        out.insert(out.end(), bits_.begin(), bits_.end());
+
+        // Write-then-rename; a lost race with another process only drops
+        // entries. A dropped entry sends the next write of that object past
+        // the existence check, which is safe because loose objects are
+        // themselves written to a temp file and renamed into place
+        error_code ec;
+        fs::create_directories(PRESENCE_PATH.parent_path(), ec);
+        static const uint64_t seed = (uint64_t(random_device{}()) << 32) ^ random_device{}();
+        ostringstream tmpName;
+        tmpName << "presence.tmp_" << hex << seed;
+        fs::path tmp = PRESENCE_PATH.parent_path() / tmpName.str();
+        {
+            ofstream f(tmp, ios::binary | ios::trunc);
+            if (!f) return;
+            f.write(reinterpret_cast<const char*>(out.data()), out.size());
+            if (!f) {
+                f.close();
+                fs::remove(tmp, ec);
+                return;
+            }
+        }
+        fs::rename(tmp, PRESENCE_PATH, ec);
+        if (ec) fs::remove(tmp, ec);
+    }
+
+private:
+    static void hashes(const ObjectId &oid, uint64_t &h1, uint64_t &h2) {
+        // SHA-1 output is uniform: two independent words are hash enough
+        memcpy(&h1, oid.bytes, 8);
+        memcpy(&h2, oid.bytes + 8, 8);
+        h2 |= 1;
+    }
+
+    void setBits(const ObjectId &oid) {
+        uint64_t h1, h2;
+        hashes(oid, h1, h2);
+        for (uint32_t i = 0; i < PROBES; ++i) {
+            uint64_t bit = (h1 + i * h2) % nbits_;
+            bits_[bit >> 3] |= uint8_t(1u << (bit & 7));
+        }
+    }
+
+    void markDirty() {
+        if (!dirty_ && !exitHook_) {
+            exitHook_ = true;
+            atexit([] { object_presence_save(); });
+        }
+        dirty_ = true;
+    }
+
+    void load() {
+        if (loaded_) return;
+        loaded_ = true;
+
+        ifstream f(PRESENCE_PATH, ios::binary);
+        if (f) {
+            uint8_t header[28];
+            if (f.read(reinterpret_cast<char*>(header), sizeof(header)) &&
+                memcmp(header, PRESENCE_MAGIC, 4) == 0 &&
+                get_be(header + 4, 4) == PRESENCE_VERSION &&
+                get_be(header + 8, 4) == PROBES) {
+                uint64_t nbits = get_be(header + 12, 8);
+                uint64_t count = get_be(header + 20, 8);
+                if (nbits >= 8 && nbits % 8 == 0 && nbits <= (uint64_t(1) << 40)) {
+                    bits_.resize(size_t(nbits / 8));
+                    if (f.read(reinterpret_cast<char*>(bits_.data()), bits_.size())) {
+                        nbits_ = nbits;
+                        count_ = count;
+                        return;
+                    }
+                }
+            }
+        }
+        rebuild(0);
+    }
+
+    // Size the filter for at least minObjects and fill it from the loose
+    // object directories (names only, no per-file stat) and the pack indexes
+    void rebuild(uint64_t minObjects) {
+        vector<ObjectId> oids;
+        error_code ec;
+        for (const auto &dir : fs::directory_iterator(OBJECTS_DIR, ec)) {
+            string prefix = dir.path().filename().string();
+            if (!is_hex_name(prefix, 2)) continue;
+            for (const auto &file : fs::directory_iterator(dir.path(), ec)) {
+                string rest = file.path().filename().string();
+                ObjectId oid;
+                if (is_hex_name(rest, 38) && ObjectId::parse(prefix + rest, oid)) oids.push_back(oid);
+            }
+        }
+        pack_for_each_object([&](const string &oid_hex, const PackedEntry &) {
+            ObjectId oid;
+            if (ObjectId::parse(oid_hex, oid)) oids.push_back(oid);
+        });
+
+        uint64_t capacity = MIN_OBJECTS;
+        while (capacity < minObjects || capacity < oids.size() * 2) capacity *= 2;
+        nbits_ = capacity * BITS_PER_OBJECT;
+        nbits_ = (nbits_ + 7) / 8 * 8;
+        bits_.assign(size_t(nbits_ / 8), 0);
+        count_ = 0;
+        for (const ObjectId &oid : oids) {
+            setBits(oid);
+            ++count_;
+        }
+        markDirty();
+    }
+
+    mutex mutex_;
+    bool loaded_ = false;
+    bool dirty_ = false;
+    bool exitHook_ = false;
+    uint64_t nbits_ = 0;
+    uint64_t count_ = 0;
+    vector<uint8_t> bits_;
+    bool knownDirs_[256] = { false };
+};
+
+static PresenceFilter &filter() {
+    static PresenceFilter instance;
+    return instance;
+}
+
+bool object_presence_maybe_has(const ObjectId &oid) {
+    return filter().maybeHas(oid);
+}
+
+void object_presence_add(const ObjectId &oid) {
+    filter().add(oid);
+}
+
+void object_presence_ensure_fanout_dir(const ObjectId &oid) {
+    filter().ensureFanoutDir(oid);
+}
+
+void object_presence_save() {
+    filter().save();
+}
@@ -0,0 +1,27 @@
+// object_presence.h
+#ifndef OBJECT_PRESENCE_H
+#define OBJECT_PRESENCE_H
+
+#include "object_id.h"
+
+// Cheap existence checks for the object write path.
+//
+// A Bloom filter of every stored oid is kept in .mintvcs/objects/info/presence
+// and rebuilt from a directory scan if it is missing or full. A "no" answer
+// lets a writer skip its stat calls; a "maybe" still needs a real lookup.
+// A stale filter (objects written by another tool) only causes a redundant,
+// identical write, so the filter must never be used to decide that an object
+// is missing for reading.
+//
+//   presence  "MBLM" | version u32 | k u32 | bits u64 | count u64 | bit array
+
+// False only if the object was never stored in this repository
+bool object_presence_maybe_has(const ObjectId &oid);
+// Record a newly stored object; the filter is saved when the process exits
+void object_presence_add(const ObjectId &oid);
+// Create .mintvcs/objects/xx for this oid unless it is already known to exist
+void object_presence_ensure_fanout_dir(const ObjectId &oid);
+// Write the filter now if it changed
+void object_presence_save();
+
+#endif
@@ -0,0 +1,138 @@
+// object_store.cpp
+#include "object_store.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace std;
+
+static const size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+// Byte-budgeted LRU of inflated objects keyed by OID, most recent first
+class ObjectStore {
+public:
+    ObjectStore() {
+        budget_ = DEFAULT_BUDGET;
+        if (const char *mb = getenv("MINTVCS_OBJECT_CACHE_MB")) {
+            char *end;
+            unsigned long long value = strtoull(mb, &end, 10);
+            if (end != mb && *end == '\0') budget_ = size_t(value) * 1024 * 1024;
+        }
+    }
+
+    ObjectRef get(const ObjectId &oid) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            auto it = index_.find(oid);
+            if (it != index_.end()) {
+                ++stats_.hits;
+                lru_.splice(lru_.begin(), lru_, it->second);
+                return it->second->second;
+            }
+            ++stats_.misses;
+        }
+
+        // Inflate outside the lock; a concurrent miss on the same oid just
+        // inflates it twice and keeps the first copy
+        ObjectRef obj = make_shared<const ObjectHandle>(read_object(oid.hex()));
+        size_t size = obj->raw().size();
+
+        lock_guard<mutex> lock(mutex_);
+        if (size > budget_ / 4) return obj;
+        auto it = index_.find(oid);
+        if (it != index_.end()) return it->second->second;
+        lru_.emplace_front(oid, obj);
+        index_[oid] = lru_.begin();
+        bytes_ += size;
+        evictOver(budget_);
+        return obj;
+    }
+
+    ObjectStoreStats stats() {
+        lock_guard<mutex> lock(mutex_);
+        ObjectStoreStats s = stats_;
+        s.bytes = bytes_;
+        s.budget = budget_;
+        return s;
+    }
+
+    void setBudget(size_t bytes) {
+        lock_guard<mutex> lock(mutex_);
+        budget_ = bytes;
+        evictOver(budget_);
+    }
+
+    void clear() {
+        lock_guard<mutex> lock(mutex_);
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+private:
+    typedef list<pair<ObjectId, ObjectRef>> Entries;
+
+    void evictOver(size_t limit) {
+        while (bytes_ > limit && !lru_.empty()) {
+            bytes_ -= lru_.back().second->raw().size();
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+            ++stats_.evictions;
+        }
+    }
+
+    mutex mutex_;
+    Entries lru_;
+    unordered_map<ObjectId, Entries::iterator, ObjectIdHash> index_;
+    size_t bytes_ = 0;
+    size_t budget_;
+    ObjectStoreStats stats_;
+};
+
+static void print_stats() {
+    ObjectStoreStats s = object_store_stats();
+    fprintf(stderr, "object cache: %llu hits, %llu misses, %llu evictions, %zu/%zu bytes\n",
+            (unsigned long long)s.hits, (unsigned long long)s.misses,
+            (unsigned long long)s.evictions, s.bytes, s.budget);
+}
+
+static ObjectStore &store() {
+    static ObjectStore instance;
+    static bool traced = [] {
+        // MINTVCS_TRACE_OBJECTS=1 prints the counters when the command exits
+        const char *trace = getenv("MINTVCS_TRACE_OBJECTS");
+        if (trace && *trace && *trace != '0') atexit(print_stats);
+        return true;
+    }();
+    (void)traced;
+    return instance;
+}
+
+ObjectRef object_store_get(const ObjectId &oid, string_view expectedType) {
+    ObjectRef obj = store().get(oid);
+    if (!expectedType.empty() && obj->type() != expectedType)
+        throw runtime_error("Object is not a " + string(expectedType) + ": " + oid.hex());
+    return obj;
+}
+
+ObjectRef object_store_get(const string &oid_hex, string_view expectedType) {
+    ObjectId oid;
+    if (!ObjectId::parse(oid_hex, oid)) throw runtime_error("Object not found: " + oid_hex);
+    return object_store_get(oid, expectedType);
+}
+
+ObjectStoreStats object_store_stats() {
+    return store().stats();
+}
+
+void object_store_set_budget(size_t bytes) {
+    store().setBudget(bytes);
+}
+
+void object_store_clear() {
+    store().clear();
+}
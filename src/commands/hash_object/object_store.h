@@ -0,0 +1,36 @@
+// object_store.h
+#ifndef OBJECT_STORE_H
+#define OBJECT_STORE_H
+
+#include "hash_object.h"
+#include "object_id.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// Inflated objects shared by every command in the process. Entries are
+// immutable, so a handle stays valid after its slot has been evicted.
+typedef std::shared_ptr<const ObjectHandle> ObjectRef;
+
+struct ObjectStoreStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t bytes = 0;   // inflated bytes currently cached
+    size_t budget = 0;
+};
+
+// Read an object through the cache. With expectedType set, throws if the
+// object has a different type.
+ObjectRef object_store_get(const ObjectId &oid, std::string_view expectedType = std::string_view());
+ObjectRef object_store_get(const std::string &oid_hex, std::string_view expectedType = std::string_view());
+ObjectStoreStats object_store_stats();
+// Byte budget for cached objects; 64 MB unless MINTVCS_OBJECT_CACHE_MB is set.
+// Objects over a quarter of the budget are returned but not kept.
+void object_store_set_budget(size_t bytes);
+void object_store_clear();
+
+#endif
@@ -0,0 +1,439 @@
+// pack.cpp
+#include "pack.h"
+#include "delta.h"
+#include "hash_object.h"
+#include "mapped_file.h"
+#include "object_id.h"
+#include "sha1.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <zlib.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const fs::path PACK_DIR = ".mintvcs/objects/pack";
+static const char PACK_MAGIC[4] = { 'M', 'P', 'A', 'K' };
+static const char IDX_MAGIC[4] = { 'M', 'I', 'D', 'X' };
+static const uint32_t PACK_VERSION = 1;
+
+static const size_t PACK_HEADER_SIZE = 12;
+static const size_t IDX_HEADER_SIZE = 8 + 256 * 4;
+static const size_t IDX_ENTRY_SIZE = 20 + 8 + 8;
+
+// ----------------- Encoding helpers -----------------
+
+static uint32_t read_be32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static uint64_t read_be64(const uint8_t *p) {
+    return (uint64_t(read_be32(p)) << 32) | read_be32(p + 4);
+}
+
+static void put_be32(vector<uint8_t> &out, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back(uint8_t(v >> shift));
+}
+
+static void put_be64(vector<uint8_t> &out, uint64_t v) {
+    put_be32(out, uint32_t(v >> 32));
+    put_be32(out, uint32_t(v));
+}
+
+static bool hex_to_oid(const string &hex, uint8_t out[20]) {
+    return hex.size() == 40 && hex_decode(hex.data(), 20, out);
+}
+
+static string oid_to_hex(const uint8_t *oid) {
+    return ObjectId(oid).hex();
+}
+
+// ----------------- One mapped pack -----------------
+
+struct Pack {
+    MappedFile idx;
+    MappedFile data;
+    uint32_t count = 0;
+    const uint8_t *fanout = nullptr;
+    const uint8_t *oids = nullptr;
+    const uint8_t *offsets = nullptr;
+    const uint8_t *lengths = nullptr;
+
+    bool load(const string &base) {
+        if (!idx.open(base + ".idx") || !data.open(base + ".pack")) return false;
+
+        const uint8_t *p = idx.data();
+        if (idx.size() < IDX_HEADER_SIZE + 40 || memcmp(p, IDX_MAGIC, 4) != 0 ||
+            read_be32(p + 4) != PACK_VERSION)
+            return false;
+
+        fanout = p + 8;
+        count = read_be32(fanout + 255 * 4);
+        if (idx.size() != IDX_HEADER_SIZE + size_t(count) * IDX_ENTRY_SIZE + 40) return false;
+
+        const uint8_t *d = data.data();
+        if (data.size() < PACK_HEADER_SIZE + 20 || memcmp(d, PACK_MAGIC, 4) != 0 ||
+            read_be32(d + 4) != PACK_VERSION || read_be32(d + 8) != count)
+            return false;
+
+        oids = p + IDX_HEADER_SIZE;
+        offsets = oids + size_t(count) * 20;
+        lengths = offsets + size_t(count) * 8;
+        return true;
+    }
+
+    // Position of oid in the sorted table, or -1
+    long find(const uint8_t oid[20]) const {
+        size_t lo = oid[0] == 0 ? 0 : read_be32(fanout + (oid[0] - 1) * 4);
+        size_t hi = read_be32(fanout + oid[0] * 4);
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = memcmp(oids + mid * 20, oid, 20);
+            if (cmp == 0) return long(mid);
+            if (cmp < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return -1;
+    }
+
+    PackedEntry entry(size_t i) const {
+        uint64_t off = read_be64(offsets + i * 8);
+        uint64_t len = read_be64(lengths + i * 8);
+        if (len < 1 || off < PACK_HEADER_SIZE || off + len > data.size() - 20)
+            throw runtime_error("Corrupt pack index entry");
+        PackedEntry e;
+        e.kind = data.data()[off];
+        e.data = data.data() + off + 1;
+        e.size = size_t(len - 1);
+        return e;
+    }
+};
+
+// ----------------- Repository-wide pack list -----------------
+
+static mutex packsMutex;
+static vector<unique_ptr<Pack>> packs;
+static bool packsLoaded = false;
+
+static const vector<unique_ptr<Pack>> &loaded_packs() {
+    lock_guard<mutex> lock(packsMutex);
+    if (!packsLoaded) {
+        packsLoaded = true;
+        for (const string &base : pack_list_basenames()) {
+            unique_ptr<Pack> pack(new Pack());
+            if (pack->load(base)) packs.push_back(std::move(pack));
+        }
+    }
+    return packs;
+}
+
+vector<string> pack_list_basenames() {
+    vector<string> bases;
+    error_code ec;
+    if (!fs::is_directory(PACK_DIR, ec)) return bases;
+    for (const auto &entry : fs::directory_iterator(PACK_DIR, ec)) {
+        const fs::path &p = entry.path();
+        if (p.extension() == ".idx" && p.filename().string().rfind("pack-", 0) == 0) {
+            fs::path base = p;
+            bases.push_back(base.replace_extension().string());
+        }
+    }
+    sort(bases.begin(), bases.end());
+    return bases;
+}
+
+void pack_reload() {
+    lock_guard<mutex> lock(packsMutex);
+    packs.clear();
+    packsLoaded = false;
+}
+
+bool pack_find_object(const string &oid_hex, PackedEntry &out) {
+    uint8_t oid[20];
+    if (!hex_to_oid(oid_hex, oid)) return false;
+    for (const auto &pack : loaded_packs()) {
+        long i = pack->find(oid);
+        if (i >= 0) {
+            out = pack->entry(size_t(i));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool pack_has_object(const string &oid_hex) {
+    uint8_t oid[20];
+    if (!hex_to_oid(oid_hex, oid)) return false;
+    for (const auto &pack : loaded_packs()) {
+        if (pack->find(oid) >= 0) return true;
+    }
+    return false;
+}
+
+string pack_find_prefix(const string &prefix) {
+    if (prefix.size() < 2 || prefix.size() > 40) return string();
+    uint8_t firstByte;
+    if (!hex_decode(prefix.data(), 1, &firstByte)) return string();
+    int first = firstByte;
+
+    for (const auto &pack : loaded_packs()) {
+        // scan the fan-out bucket of the first byte
+        size_t lo = first == 0 ? 0 : read_be32(pack->fanout + (first - 1) * 4);
+        size_t hi = read_be32(pack->fanout + first * 4);
+        for (size_t i = lo; i < hi; ++i) {
+            string hex = oid_to_hex(pack->oids + i * 20);
+            if (hex.compare(0, prefix.size(), prefix) == 0) return hex;
+        }
+    }
+    return string();
+}
+
+void pack_for_each_object(const function<void(const string &oid_hex, const PackedEntry &entry)> &fn) {
+    for (const auto &pack : loaded_packs()) {
+        for (size_t i = 0; i < pack->count; ++i)
+            fn(oid_to_hex(pack->oids + i * 20), pack->entry(i));
+    }
+}
+
+// ----------------- Deltas -----------------
+
+// Rebuilt delta bases, most recently used first. A chain of deltas against the
+// same base (successive versions of one file) only inflates the base once.
+static const size_t BASE_CACHE_BUDGET = 64 * 1024 * 1024;
+
+class BaseCache {
+public:
+    shared_ptr<const vector<uint8_t>> get(const string &oid) {
+        lock_guard<mutex> lock(mutex_);
+        auto it = index_.find(oid);
+        if (it == index_.end()) return nullptr;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+
+    void put(const string &oid, shared_ptr<const vector<uint8_t>> bytes) {
+        if (bytes->size() > BASE_CACHE_BUDGET / 4) return;
+        lock_guard<mutex> lock(mutex_);
+        if (index_.count(oid)) return;
+        lru_.emplace_front(oid, bytes);
+        index_[oid] = lru_.begin();
+        bytes_ += bytes->size();
+        while (bytes_ > BASE_CACHE_BUDGET) {
+            bytes_ -= lru_.back().second->size();
+            index_.erase(lru_.back().first);
+            lru_.pop_back();
+        }
+    }
+
+private:
+    typedef list<pair<string, shared_ptr<const vector<uint8_t>>>> Entries;
+    mutex mutex_;
+    Entries lru_;
+    unordered_map<string, Entries::iterator> index_;
+    size_t bytes_ = 0;
+};
+
+static BaseCache baseCache;
+
+static vector<uint8_t> resolve_delta(const PackedEntry &entry, int depth);
+
+static shared_ptr<const vector<uint8_t>> load_delta_base(const string &oid_hex, int depth) {
+    shared_ptr<const vector<uint8_t>> cached = baseCache.get(oid_hex);
+    if (cached) return cached;
+
+    PackedEntry base;
+    if (!pack_find_object(oid_hex, base)) throw runtime_error("Delta base not found: " + oid_hex);
+    vector<uint8_t> bytes;
+    if (base.kind == PACK_ENTRY_FULL) bytes = zlib_decompress_bytes(base.data, base.size);
+    else if (base.kind == PACK_ENTRY_DELTA) bytes = resolve_delta(base, depth + 1);
+    else throw runtime_error("Unsupported pack entry kind for object " + oid_hex);
+
+    shared_ptr<const vector<uint8_t>> result = make_shared<const vector<uint8_t>>(std::move(bytes));
+    baseCache.put(oid_hex, result);
+    return result;
+}
+
+static vector<uint8_t> resolve_delta(const PackedEntry &entry, int depth) {
+    if (depth > PACK_MAX_DELTA_DEPTH) throw runtime_error("Delta chain too deep");
+
+    const uint8_t *p = entry.data;
+    const uint8_t *end = entry.data + entry.size;
+    if (entry.size < 21) throw runtime_error("Corrupt delta entry");
+    string baseOid = oid_to_hex(p);
+    p += 20;
+
+    uint64_t deltaLen = 0;
+    for (int shift = 0;; shift += 7) {
+        if (p >= end || shift > 63) throw runtime_error("Corrupt delta entry");
+        uint8_t b = *p++;
+        deltaLen |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+
+    vector<uint8_t> delta(static_cast<size_t>(deltaLen));
+    uLongf outLen = static_cast<uLongf>(delta.size());
+    if (uncompress(delta.data(), &outLen, p, static_cast<uLong>(end - p)) != Z_OK || outLen != delta.size())
+        throw runtime_error("Corrupt delta data for base " + baseOid);
+
+    shared_ptr<const vector<uint8_t>> base = load_delta_base(baseOid, depth);
+    return delta_apply(base->data(), base->size(), delta.data(), delta.size());
+}
+
+vector<uint8_t> pack_resolve_delta(const PackedEntry &entry) {
+    return resolve_delta(entry, 1);
+}
+
+void pack_verify(const string &base) {
+    Pack pack;
+    if (!pack.load(base)) throw runtime_error("Unable to read pack " + base);
+    for (size_t i = 0; i < pack.count; ++i) {
+        string oid = oid_to_hex(pack.oids + i * 20);
+        PackedEntry entry = pack.entry(i);
+        vector<uint8_t> bytes;
+        if (entry.kind == PACK_ENTRY_FULL) bytes = zlib_decompress_bytes(entry.data, entry.size);
+        else if (entry.kind == PACK_ENTRY_DELTA) bytes = resolve_delta(entry, 1);
+        else throw runtime_error("Unsupported pack entry kind for object " + oid);
+        if (sha1_hex_of_bytes(bytes) != oid) throw runtime_error("Pack entry does not match its id: " + oid);
+    }
+}
+
+vector<uint8_t> pack_encode_delta(const string &base_oid_hex, const vector<uint8_t> &delta) {
+    vector<uint8_t> payload(20);
+    if (!hex_to_oid(base_oid_hex, payload.data()))
+        throw runtime_error("pack_encode_delta: invalid object id " + base_oid_hex);
+    uint64_t v = delta.size();
+    while (v >= 0x80) {
+        payload.push_back(uint8_t(v | 0x80));
+        v >>= 7;
+    }
+    payload.push_back(uint8_t(v));
+
+    uLongf bound = compressBound(static_cast<uLong>(delta.size()));
+    size_t start = payload.size();
+    payload.resize(start + bound);
+    if (compress2(payload.data() + start, &bound, delta.data(), static_cast<uLong>(delta.size()),
+                  Z_DEFAULT_COMPRESSION) != Z_OK)
+        throw runtime_error("zlib compress failed");
+    payload.resize(start + bound);
+    return payload;
+}
+
+// ----------------- Writing -----------------
+
+static fs::path make_temp_pack_path() {
+    static const uint64_t seed = (uint64_t(random_device{}()) << 32) ^ random_device{}();
+    static uint64_t counter = 0;
+    ostringstream name;
+    name << "tmp_pack_" << hex << seed << "_" << counter++;
+    return PACK_DIR / name.str();
+}
+
+string pack_write(vector<string> oids,
+                  const function<void(const string &oid_hex, uint8_t &kind, vector<uint8_t> &payload)> &fetch) {
+    sort(oids.begin(), oids.end());
+    oids.erase(unique(oids.begin(), oids.end()), oids.end());
+
+    vector<uint8_t> binOids(oids.size() * 20);
+    for (size_t i = 0; i < oids.size(); ++i) {
+        if (!hex_to_oid(oids[i], binOids.data() + i * 20))
+            throw runtime_error("pack_write: invalid object id " + oids[i]);
+    }
+
+    fs::create_directories(PACK_DIR);
+    fs::path tmpPack = make_temp_pack_path();
+    fs::path tmpIdx = make_temp_pack_path();
+
+    try {
+        ofstream out(tmpPack, ios::binary | ios::trunc);
+        if (!out) throw runtime_error("Unable to create pack file: " + tmpPack.string());
+
+        SHA1_CTX ctx;
+        sha1_init(ctx);
+        uint64_t pos = 0;
+        auto emit = [&](const uint8_t *p, size_t n) {
+            out.write(reinterpret_cast<const char*>(p), n);
+            sha1_update(ctx, p, n);
+            pos += n;
+        };
+
+        vector<uint8_t> header(PACK_MAGIC, PACK_MAGIC + 4);
+        put_be32(header, PACK_VERSION);
+        put_be32(header, uint32_t(oids.size()));
+        emit(header.data(), header.size());
+
+        vector<uint64_t> offsets, lengths;
+        offsets.reserve(oids.size());
+        lengths.reserve(oids.size());
+        vector<uint8_t> payload;
+        for (const string &oid : oids) {
+            uint8_t kind = PACK_ENTRY_FULL;
+            payload.clear();
+            fetch(oid, kind, payload);
+            offsets.push_back(pos);
+            emit(&kind, 1);
+            emit(payload.data(), payload.size());
+            lengths.push_back(1 + payload.size());
+        }
+
+        uint8_t packSum[20];
+        sha1_final(ctx, packSum);
+        out.write(reinterpret_cast<const char*>(packSum), 20);
+        out.close();
+        if (!out) throw runtime_error("Unable to write pack file: " + tmpPack.string());
+
+        // Build the idx in memory: fan-out, sorted oids, offsets, lengths, checksums
+        vector<uint8_t> idx(IDX_MAGIC, IDX_MAGIC + 4);
+        idx.reserve(IDX_HEADER_SIZE + oids.size() * IDX_ENTRY_SIZE + 40);
+        put_be32(idx, PACK_VERSION);
+        uint32_t counts[256] = { 0 };
+        for (size_t i = 0; i < oids.size(); ++i) counts[binOids[i * 20]]++;
+        uint32_t running = 0;
+        for (int b = 0; b < 256; ++b) {
+            running += counts[b];
+            put_be32(idx, running);
+        }
+        idx.insert(idx.end(), binOids.begin(), binOids.end());
+        for (uint64_t off : offsets) put_be64(idx, off);
+        for (uint64_t len : lengths) put_be64(idx, len);
+        idx.insert(idx.end(), packSum, packSum + 20);
+
+        SHA1_CTX idxCtx;
+        sha1_init(idxCtx);
+        sha1_update(idxCtx, idx.data(), idx.size());
+        uint8_t idxSum[20];
+        sha1_final(idxCtx, idxSum);
+        idx.insert(idx.end(), idxSum, idxSum + 20);
+
+        ofstream idxOut(tmpIdx, ios::binary | ios::trunc);
+        if (!idxOut) throw runtime_error("Unable to create pack index: " + tmpIdx.string());
+        idxOut.write(reinterpret_cast<const char*>(idx.data()), idx.size());
+        idxOut.close();
+        if (!idxOut) throw runtime_error("Unable to write pack index: " + tmpIdx.string());
+
+        // The .pack goes in first: an .idx is only ever visible next to its pack
+        string base = (PACK_DIR / ("pack-" + oid_to_hex(packSum))).string();
+        if (fs::exists(base + ".idx")) {
+            fs::remove(tmpPack);
+            fs::remove(tmpIdx);
+            return base;
+        }
+        fs::rename(tmpPack, base + ".pack");
+        fs::rename(tmpIdx, base + ".idx");
+        return base;
+    } catch (...) {
+        error_code ec;
+        fs::remove(tmpPack, ec);
+        fs::remove(tmpIdx, ec);
+        throw;
+    }
+}
@@ -0,0 +1,64 @@
+// pack.h
+#ifndef PACK_H
+#define PACK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Pack storage under .mintvcs/objects/pack:
+//
+//   pack-<sha>.pack  "MPAK" | version u32 | count u32 | entries... | SHA-1 of the above
+//                    entry: kind u8 | payload
+//                      full:  zlib stream of "<type> <size>\0<body>"
+//                      delta: base oid[20] | varint delta length | zlib stream of
+//                             a delta (see delta.h) that rebuilds the full bytes
+//   pack-<sha>.idx   "MIDX" | version u32 | fanout[256] u32 | oids[count][20]
+//                    | offsets[count] u64 | lengths[count] u64
+//                    | pack SHA-1 | SHA-1 of the above
+//
+// All integers are big-endian. oids are sorted; fanout[b] is the number of
+// oids whose first byte is <= b, so a lookup is one binary search in a bucket.
+
+static const uint8_t PACK_ENTRY_FULL = 1;
+static const uint8_t PACK_ENTRY_DELTA = 2;
+
+// Deepest delta chain repack will build
+static const int PACK_MAX_DELTA_DEPTH = 50;
+
+// A packed entry: a view into the mapped .pack file
+struct PackedEntry {
+    uint8_t kind;
+    const uint8_t *data; // payload after the kind byte
+    size_t size;
+};
+
+// Lookups across every pack in the repository; idx files are mapped on first use
+bool pack_find_object(const std::string &oid_hex, PackedEntry &out);
+bool pack_has_object(const std::string &oid_hex);
+// First packed oid starting with the given hex prefix, or "" if none
+std::string pack_find_prefix(const std::string &prefix);
+// Rebuild a delta entry into the full "<type> <size>\0<body>" bytes. Bases
+// along the chain are kept in a small byte-budgeted cache for later reads.
+std::vector<uint8_t> pack_resolve_delta(const PackedEntry &entry);
+// Build a delta payload (base oid | length | zlib data) for pack_write
+std::vector<uint8_t> pack_encode_delta(const std::string &base_oid_hex, const std::vector<uint8_t> &delta);
+// Every packed oid with its entry
+void pack_for_each_object(const std::function<void(const std::string &oid_hex, const PackedEntry &entry)> &fn);
+// Base paths (without .pack/.idx) of the packs currently in the repository
+std::vector<std::string> pack_list_basenames();
+// Drop mapped packs so files written or removed since are seen on the next lookup
+void pack_reload();
+// Inflate every entry of the pack at base and check it hashes to its oid;
+// throws on the first that does not. Delta bases come from all packs.
+void pack_verify(const std::string &base);
+
+// Write a new pack + idx holding the given oids. fetch fills the entry kind and
+// payload for one oid; objects are written one at a time. Returns the pack base path.
+std::string pack_write(std::vector<std::string> oids,
+                       const std::function<void(const std::string &oid_hex, uint8_t &kind,
+                                                std::vector<uint8_t> &payload)> &fetch);
+
+#endif
@@ -0,0 +1,438 @@
+// sha1.cpp
+// SHA-1 with a scalar reference compression function plus SSSE3, AVX2 and
+// SHA-NI kernels. The kernel is picked once at startup through CPUID.
+#include "sha1.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MINTVCS_SHA1_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+typedef void (*sha1_blocks_fn)(uint32_t state[5], const uint8_t *data, size_t nblocks);
+
+static const uint32_t K0 = 0x5A827999;
+static const uint32_t K1 = 0x6ED9EBA1;
+static const uint32_t K2 = 0x8F1BBCDC;
+static const uint32_t K3 = 0xCA62C1D6;
+
+static inline uint32_t rol(uint32_t value, unsigned int bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+// ----------------- Scalar reference -----------------
+
+void sha1_transform(uint32_t state[5], const uint8_t buffer[64]) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t(buffer[i*4]) << 24) |
+               (uint32_t(buffer[i*4+1]) << 16) |
+               (uint32_t(buffer[i*4+2]) << 8) |
+               (uint32_t(buffer[i*4+3]));
+    }
+    for (int i = 16; i < 80; ++i)
+        w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    uint32_t a = state[0];
+    uint32_t b = state[1];
+    uint32_t c = state[2];
+    uint32_t d = state[3];
+    uint32_t e = state[4];
+
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | ((~b) & d);
+            k = K0;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = K1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = K2;
+        } else {
+            f = b ^ c ^ d;
+            k = K3;
+        }
+        uint32_t temp = rol(a,5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b,30);
+        b = a;
+        a = temp;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static void sha1_blocks_scalar(uint32_t state[5], const uint8_t *data, size_t nblocks) {
+    for (; nblocks; --nblocks, data += 64)
+        sha1_transform(state, data);
+}
+
+#ifdef MINTVCS_SHA1_X86
+
+// ----------------- SSSE3 / AVX2: vectorised message schedule -----------------
+
+// 80 rounds over a precomputed W[i] + K[i] schedule.
+static inline void sha1_rounds_wk(uint32_t state[5], const uint32_t wk[80]) {
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    int i = 0;
+    for (; i < 20; ++i) {
+        uint32_t t = rol(a,5) + (d ^ (b & (c ^ d))) + e + wk[i];
+        e = d; d = c; c = rol(b,30); b = a; a = t;
+    }
+    for (; i < 40; ++i) {
+        uint32_t t = rol(a,5) + (b ^ c ^ d) + e + wk[i];
+        e = d; d = c; c = rol(b,30); b = a; a = t;
+    }
+    for (; i < 60; ++i) {
+        uint32_t t = rol(a,5) + ((b & c) | (d & (b | c))) + e + wk[i];
+        e = d; d = c; c = rol(b,30); b = a; a = t;
+    }
+    for (; i < 80; ++i) {
+        uint32_t t = rol(a,5) + (b ^ c ^ d) + e + wk[i];
+        e = d; d = c; c = rol(b,30); b = a; a = t;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static inline uint32_t round_constant(int i) {
+    return i < 20 ? K0 : i < 40 ? K1 : i < 60 ? K2 : K3;
+}
+
+// Four schedule words at a time. w0..w3 hold W[i-16..i-1]; W[i+3] depends on
+// W[i] from the same vector, so it is computed with W[i] = 0 and patched after.
+__attribute__((target("ssse3")))
+static void sha1_blocks_ssse3(uint32_t state[5], const uint8_t *data, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+    alignas(16) uint32_t wk[80];
+
+    for (; nblocks; --nblocks, data += 64) {
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data)), bswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        __m128i k = _mm_set1_epi32(int(K0));
+        _mm_store_si128((__m128i*)(wk), _mm_add_epi32(w0, k));
+        _mm_store_si128((__m128i*)(wk + 4), _mm_add_epi32(w1, k));
+        _mm_store_si128((__m128i*)(wk + 8), _mm_add_epi32(w2, k));
+        _mm_store_si128((__m128i*)(wk + 12), _mm_add_epi32(w3, k));
+
+        for (int i = 16; i < 80; i += 4) {
+            __m128i t = _mm_xor_si128(_mm_srli_si128(w3, 4), w2);
+            t = _mm_xor_si128(t, _mm_alignr_epi8(w1, w0, 8));
+            t = _mm_xor_si128(t, w0);
+            t = _mm_or_si128(_mm_slli_epi32(t, 1), _mm_srli_epi32(t, 31));
+            __m128i fix = _mm_slli_si128(t, 12);
+            t = _mm_xor_si128(t, _mm_or_si128(_mm_slli_epi32(fix, 1), _mm_srli_epi32(fix, 31)));
+
+            w0 = w1; w1 = w2; w2 = w3; w3 = t;
+            k = _mm_set1_epi32(int(round_constant(i)));
+            _mm_store_si128((__m128i*)(wk + i), _mm_add_epi32(t, k));
+        }
+
+        sha1_rounds_wk(state, wk);
+    }
+}
+
+// Same schedule as the SSSE3 kernel, two blocks at once (one per 128-bit lane).
+__attribute__((target("avx2")))
+static void sha1_blocks_avx2(uint32_t state[5], const uint8_t *data, size_t nblocks) {
+    const __m256i bswap = _mm256_set_epi8(12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3,
+                                          12,13,14,15, 8,9,10,11, 4,5,6,7, 0,1,2,3);
+    alignas(32) uint32_t wk[2][80];
+
+    for (; nblocks >= 2; nblocks -= 2, data += 128) {
+        __m256i w[4];
+        for (int j = 0; j < 4; ++j) {
+            __m128i lo = _mm_loadu_si128((const __m128i*)(data + 16 * j));
+            __m128i hi = _mm_loadu_si128((const __m128i*)(data + 64 + 16 * j));
+            w[j] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1), bswap);
+        }
+        __m256i w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3];
+
+        __m256i k = _mm256_set1_epi32(int(K0));
+        for (int j = 0; j < 4; ++j) {
+            __m256i t = _mm256_add_epi32(w[j], k);
+            _mm_store_si128((__m128i*)(wk[0] + 4 * j), _mm256_castsi256_si128(t));
+            _mm_store_si128((__m128i*)(wk[1] + 4 * j), _mm256_extracti128_si256(t, 1));
+        }
+
+        for (int i = 16; i < 80; i += 4) {
+            __m256i t = _mm256_xor_si256(_mm256_srli_si256(w3, 4), w2);
+            t = _mm256_xor_si256(t, _mm256_alignr_epi8(w1, w0, 8));
+            t = _mm256_xor_si256(t, w0);
+            t = _mm256_or_si256(_mm256_slli_epi32(t, 1), _mm256_srli_epi32(t, 31));
+            __m256i fix = _mm256_slli_si256(t, 12);
+            t = _mm256_xor_si256(t, _mm256_or_si256(_mm256_slli_epi32(fix, 1), _mm256_srli_epi32(fix, 31)));
+
+            w0 = w1; w1 = w2; w2 = w3; w3 = t;
+            k = _mm256_set1_epi32(int(round_constant(i)));
+            t = _mm256_add_epi32(t, k);
+            _mm_store_si128((__m128i*)(wk[0] + i), _mm256_castsi256_si128(t));
+            _mm_store_si128((__m128i*)(wk[1] + i), _mm256_extracti128_si256(t, 1));
+        }
+
+        sha1_rounds_wk(state, wk[0]);
+        sha1_rounds_wk(state, wk[1]);
+    }
+
+    if (nblocks)
+        sha1_blocks_ssse3(state, data, nblocks);
+}
+
+// ----------------- SHA-NI -----------------
+
+// One group of four rounds once the message schedule is in steady state:
+// rounds with E_CUR/M_A, finish M_B, start M_D, fold M_A into M_C.
+#define SHA1NI_STEP(E_CUR, E_NEXT, M_A, M_B, M_C, M_D, FUNC)   \
+    E_CUR = _mm_sha1nexte_epu32(E_CUR, M_A);                   \
+    E_NEXT = abcd;                                              \
+    M_B = _mm_sha1msg2_epu32(M_B, M_A);                         \
+    abcd = _mm_sha1rnds4_epu32(abcd, E_CUR, FUNC);              \
+    M_D = _mm_sha1msg1_epu32(M_D, M_A);                         \
+    M_C = _mm_xor_si128(M_C, M_A);
+
+__attribute__((target("sha,sse4.1")))
+static void sha1_blocks_shani(uint32_t state[5], const uint8_t *data, size_t nblocks) {
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1B);
+    __m128i e0 = _mm_set_epi32(int(state[4]), 0, 0, 0);
+    __m128i e1;
+
+    for (; nblocks; --nblocks, data += 64) {
+        __m128i abcdSave = abcd;
+        __m128i e0Save = e0;
+
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data)), bswap);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 16)), bswap);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 32)), bswap);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(data + 48)), bswap);
+
+        // Rounds 0-15: load the block and start the schedule
+        e0 = _mm_add_epi32(e0, m0);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 0);
+        m0 = _mm_sha1msg1_epu32(m0, m1);
+
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+        m1 = _mm_sha1msg1_epu32(m1, m2);
+        m0 = _mm_xor_si128(m0, m2);
+
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 0)
+
+        // Rounds 16-67
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 0)
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 1)
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 1)
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 1)
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 1)
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 1)
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 2)
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 2)
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 2)
+        SHA1NI_STEP(e1, e0, m1, m2, m3, m0, 2)
+        SHA1NI_STEP(e0, e1, m2, m3, m0, m1, 2)
+        SHA1NI_STEP(e1, e0, m3, m0, m1, m2, 3)
+        SHA1NI_STEP(e0, e1, m0, m1, m2, m3, 3)
+
+        // Rounds 68-79: schedule winds down
+        e1 = _mm_sha1nexte_epu32(e1, m1);
+        e0 = abcd;
+        m2 = _mm_sha1msg2_epu32(m2, m1);
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+        m3 = _mm_xor_si128(m3, m1);
+
+        e0 = _mm_sha1nexte_epu32(e0, m2);
+        e1 = abcd;
+        m3 = _mm_sha1msg2_epu32(m3, m2);
+        abcd = _mm_sha1rnds4_epu32(abcd, e0, 3);
+
+        e1 = _mm_sha1nexte_epu32(e1, m3);
+        e0 = abcd;
+        abcd = _mm_sha1rnds4_epu32(abcd, e1, 3);
+
+        e0 = _mm_sha1nexte_epu32(e0, e0Save);
+        abcd = _mm_add_epi32(abcd, abcdSave);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = uint32_t(_mm_extract_epi32(e0, 3));
+}
+
+#undef SHA1NI_STEP
+
+// ----------------- CPUID dispatch -----------------
+
+struct CpuFeatures {
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+    bool sha = false;
+};
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures f;
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    bool osAvx = false;
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        f.ssse3 = (ecx & (1u << 9)) != 0;
+        f.sse41 = (ecx & (1u << 19)) != 0;
+        bool osxsave = (ecx & (1u << 27)) != 0;
+        bool avx = (ecx & (1u << 28)) != 0;
+        if (osxsave && avx) {
+            // OS must save YMM state (XCR0 bits 1 and 2) before AVX2 is usable
+            unsigned int xcr0Lo, xcr0Hi;
+            __asm__ volatile("xgetbv" : "=a"(xcr0Lo), "=d"(xcr0Hi) : "c"(0));
+            osAvx = (xcr0Lo & 6u) == 6u;
+        }
+    }
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        f.avx2 = osAvx && (ebx & (1u << 5)) != 0;
+        f.sha = (ebx & (1u << 29)) != 0;
+    }
+    return f;
+}
+
+#endif // MINTVCS_SHA1_X86
+
+struct Sha1Kernel {
+    sha1_blocks_fn blocks;
+    const char *name;
+};
+
+// The kernel called name, if this CPU can run it
+static bool kernel_by_name(const string &name, Sha1Kernel &out) {
+    if (name == "scalar") {
+        out = { sha1_blocks_scalar, "scalar" };
+        return true;
+    }
+#ifdef MINTVCS_SHA1_X86
+    CpuFeatures cpu = detect_cpu_features();
+    if (name == "ssse3" && cpu.ssse3) {
+        out = { sha1_blocks_ssse3, "ssse3" };
+        return true;
+    }
+    if (name == "avx2" && cpu.avx2) {
+        out = { sha1_blocks_avx2, "avx2" };
+        return true;
+    }
+    if (name == "shani" && cpu.sha && cpu.ssse3 && cpu.sse41) {
+        out = { sha1_blocks_shani, "shani" };
+        return true;
+    }
+#endif
+    return false;
+}
+
+static Sha1Kernel select_kernel() {
+    Sha1Kernel kernel;
+    const char *forced = getenv("MINTVCS_SHA1");
+    if (forced && *forced && kernel_by_name(forced, kernel)) return kernel;
+
+    for (const char *name : { "shani", "avx2", "ssse3" }) {
+        if (kernel_by_name(name, kernel)) return kernel;
+    }
+    kernel_by_name("scalar", kernel);
+    return kernel;
+}
+
+static Sha1Kernel &active_kernel() {
+    static Sha1Kernel kernel = select_kernel();
+    return kernel;
+}
+
+bool sha1_use_kernel(const char *name) {
+    return kernel_by_name(name, active_kernel());
+}
+
+const char *sha1_kernel_name() {
+    return active_kernel().name;
+}
+
+// ----------------- Streaming interface -----------------
+
+void sha1_init(SHA1_CTX &ctx) {
+    ctx.state[0] = 0x67452301;
+    ctx.state[1] = 0xEFCDAB89;
+    ctx.state[2] = 0x98BADCFE;
+    ctx.state[3] = 0x10325476;
+    ctx.state[4] = 0xC3D2E1F0;
+    ctx.count = 0;
+    memset(ctx.buffer, 0, sizeof(ctx.buffer));
+}
+
+void sha1_update(SHA1_CTX &ctx, const uint8_t *data, size_t len) {
+    sha1_blocks_fn blocks = active_kernel().blocks;
+    size_t i = 0;
+    size_t idx = (ctx.count >> 3) & 0x3F;
+    ctx.count += static_cast<uint64_t>(len) << 3;
+
+    if (idx) {
+        size_t fill = 64 - idx;
+        if (len >= fill) {
+            memcpy(ctx.buffer + idx, data, fill);
+            blocks(ctx.state, ctx.buffer, 1);
+            i += fill;
+            idx = 0;
+        } else {
+            memcpy(ctx.buffer + idx, data, len);
+            return;
+        }
+    }
+
+    size_t nblocks = (len - i) / 64;
+    if (nblocks) {
+        blocks(ctx.state, data + i, nblocks);
+        i += nblocks * 64;
+    }
+
+    if (i < len)
+        memcpy(ctx.buffer, data + i, len - i);
+}
+
+void sha1_final(SHA1_CTX &ctx, uint8_t digest[20]) {
+    uint8_t padding[64] = { 0x80 };
+    uint8_t bits[8];
+    uint64_t cnt = ctx.count;
+    for (int i = 0; i < 8; ++i) {
+        bits[7 - i] = static_cast<uint8_t>(cnt & 0xff);
+        cnt >>= 8;
+    }
+
+    size_t idx = (ctx.count >> 3) & 0x3F;
+    size_t padLen = (idx < 56) ? (56 - idx) : (120 - idx);
+    sha1_update(ctx, padding, padLen);
+    sha1_update(ctx, bits, 8);
+
+    for (int i = 0; i < 5; ++i) {
+        digest[i*4]     = static_cast<uint8_t>((ctx.state[i] >> 24) & 0xff);
+        digest[i*4 + 1] = static_cast<uint8_t>((ctx.state[i] >> 16) & 0xff);
+        digest[i*4 + 2] = static_cast<uint8_t>((ctx.state[i] >> 8) & 0xff);
+        digest[i*4 + 3] = static_cast<uint8_t>((ctx.state[i]) & 0xff);
+    }
+}
@@ -0,0 +1,28 @@
+// sha1.h
+#ifndef SHA1_H
+#define SHA1_H
+
+#include <cstddef>
+#include <cstdint>
+
+struct SHA1_CTX {
+    uint32_t state[5];
+    uint64_t count;
+    uint8_t buffer[64];
+};
+
+void sha1_init(SHA1_CTX &ctx);
+void sha1_update(SHA1_CTX &ctx, const uint8_t *data, size_t len);
+void sha1_final(SHA1_CTX &ctx, uint8_t digest[20]);
+
+// Scalar reference compression function (one 64-byte block).
+void sha1_transform(uint32_t state[5], const uint8_t buffer[64]);
+
+// Name of the compression kernel picked at startup: "shani", "avx2", "ssse3" or "scalar".
+// Can be forced with the MINTVCS_SHA1 environment variable.
+const char *sha1_kernel_name();
+// Switch to the named kernel, as MINTVCS_SHA1 does; false if this CPU cannot
+// run it. Not thread-safe: for tests and benchmarks only.
+bool sha1_use_kernel(const char *name);
+
+#endif
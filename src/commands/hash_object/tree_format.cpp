@@ -0,0 +1,50 @@
+// tree_format.cpp
+#include "tree_format.h"
+
+#include <stdexcept>
+
+using namespace std;
+
+void tree_for_each_entry(string_view body, const function<void(const TreeEntryView &entry)> &fn) {
+    size_t oidLen = 40;
+    size_t pos = 0;
+    if (!body.empty() && body[0] == '\0') {
+        if (body.size() < 2 || uint8_t(body[1]) != TREE_FORMAT_VERSION)
+            throw runtime_error("Unsupported tree format");
+        oidLen = 20;
+        pos = 2;
+    }
+
+    while (pos < body.size()) {
+        size_t spacePos = body.find(' ', pos);
+        if (spacePos == string_view::npos) throw runtime_error("Malformed tree entry (mode)");
+        size_t nullPos = body.find('\0', spacePos + 1);
+        if (nullPos == string_view::npos || body.size() - (nullPos + 1) < oidLen)
+            throw runtime_error("Malformed tree entry (name)");
+
+        TreeEntryView entry;
+        entry.mode = body.substr(pos, spacePos - pos);
+        entry.name = body.substr(spacePos + 1, nullPos - spacePos - 1);
+        const char *oid = body.data() + nullPos + 1;
+        if (oidLen == 20) {
+            memcpy(entry.oid.bytes, oid, 20);
+        } else if (!hex_decode(oid, 20, entry.oid.bytes)) {
+            throw runtime_error("Malformed tree entry (object id)");
+        }
+        fn(entry);
+        pos = nullPos + 1 + oidLen;
+    }
+}
+
+void tree_begin(string &body) {
+    body.push_back('\0');
+    body.push_back(char(TREE_FORMAT_VERSION));
+}
+
+void tree_append_entry(string &body, string_view mode, string_view name, const ObjectId &oid) {
+    body.append(mode);
+    body.push_back(' ');
+    body.append(name);
+    body.push_back('\0');
+    body.append(reinterpret_cast<const char*>(oid.bytes), 20);
+}
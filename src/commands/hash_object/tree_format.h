@@ -0,0 +1,36 @@
+// tree_format.h
+#ifndef TREE_FORMAT_H
+#define TREE_FORMAT_H
+
+#include "object_id.h"
+
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Tree object bodies come in two versions:
+//   v1: entries "<mode> <name>\0<40 hex oid>"
+//   v2: "\0" 0x02, then entries "<mode> <name>\0<20-byte oid>"
+// A v1 body never starts with NUL (modes are digits), so readers tell them
+// apart from the first byte. New trees are always written as v2.
+static const uint8_t TREE_FORMAT_VERSION = 2;
+
+static const char TREE_MODE_FILE[] = "100644";
+static const char TREE_MODE_DIR[] = "40000";
+
+struct TreeEntryView {
+    std::string_view mode;
+    std::string_view name;
+    ObjectId oid;
+
+    bool isDir() const { return mode == TREE_MODE_DIR; }
+};
+
+// Call fn for each entry of a tree body (either version); throws on a malformed tree
+void tree_for_each_entry(std::string_view body, const std::function<void(const TreeEntryView &entry)> &fn);
+
+// Build a v2 tree body: start with tree_begin, then append entries in order
+void tree_begin(std::string &body);
+void tree_append_entry(std::string &body, std::string_view mode, std::string_view name, const ObjectId &oid);
+
+#endif
@@ -0,0 +1,97 @@
+// work_pool.cpp
+#include "work_pool.h"
+
+using namespace std;
+
+WorkPool::WorkPool(unsigned threads) : threads_(threads ? threads : 1) {
+    if (threads_ == 1) return;
+    for (unsigned i = 0; i < threads_; ++i) queues_.emplace_back(new Queue());
+    for (unsigned i = 0; i < threads_; ++i) workers_.emplace_back([this, i] { workerLoop(i); });
+}
+
+WorkPool::~WorkPool() {
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        stopping_ = true;
+    }
+    workReady_.notify_all();
+    for (thread &worker : workers_) worker.join();
+}
+
+void WorkPool::submit(function<void()> job) {
+    if (workers_.empty()) {
+        runJob(job);
+        return;
+    }
+
+    unsigned target;
+    {
+        lock_guard<mutex> lock(stateMutex_);
+        target = nextQueue_++ % threads_;
+        ++pending_;
+        // counted before it is visible, so a worker never sees queued_ wrap
+        ++queued_;
+    }
+    {
+        lock_guard<mutex> lock(queues_[target]->mutex);
+        queues_[target]->jobs.push_back(std::move(job));
+    }
+    workReady_.notify_one();
+}
+
+void WorkPool::wait() {
+    unique_lock<mutex> lock(stateMutex_);
+    allDone_.wait(lock, [this] { return pending_ == 0; });
+    if (error_) {
+        exception_ptr error = error_;
+        error_ = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void WorkPool::runJob(function<void()> &job) {
+    try {
+        job();
+    } catch (...) {
+        lock_guard<mutex> lock(stateMutex_);
+        if (!error_) error_ = current_exception();
+    }
+}
+
+bool WorkPool::takeJob(unsigned self, function<void()> &job) {
+    // own deque first (oldest job), then steal the newest job of a neighbour
+    for (unsigned i = 0; i < threads_; ++i) {
+        Queue &queue = *queues_[(self + i) % threads_];
+        lock_guard<mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) continue;
+        if (i == 0) {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        } else {
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        }
+        return true;
+    }
+    return false;
+}
+
+void WorkPool::workerLoop(unsigned self) {
+    while (true) {
+        function<void()> job;
+        if (takeJob(self, job)) {
+            {
+                lock_guard<mutex> lock(stateMutex_);
+                --queued_;
+            }
+            runJob(job);
+            lock_guard<mutex> lock(stateMutex_);
+            if (--pending_ == 0) allDone_.notify_all();
+            continue;
+        }
+
+        unique_lock<mutex> lock(stateMutex_);
+        workReady_.wait(lock, [this] { return stopping_ || queued_ > 0; });
+        if (stopping_ && queued_ == 0) return;
+    }
+}
@@ -0,0 +1,58 @@
+// work_pool.h
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own job deque. submit() deals
+// jobs out round-robin; a worker takes from the front of its own deque and,
+// once that is empty, steals from the back of the others. With one thread
+// jobs run inline in submit(), so callers need no serial special case.
+class WorkPool {
+public:
+    explicit WorkPool(unsigned threads);
+    ~WorkPool();
+
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    void submit(std::function<void()> job);
+    // Block until every submitted job has run; rethrows the first exception
+    // a job threw (the remaining jobs still run)
+    void wait();
+
+    unsigned threads() const { return threads_; }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    void workerLoop(unsigned self);
+    bool takeJob(unsigned self, std::function<void()> &job);
+    void runJob(std::function<void()> &job);
+
+    unsigned threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex stateMutex_;
+    std::condition_variable workReady_;
+    std::condition_variable allDone_;
+    size_t queued_ = 0;   // submitted, not yet taken
+    size_t pending_ = 0;  // submitted, not yet finished
+    unsigned nextQueue_ = 0;
+    bool stopping_ = false;
+    std::exception_ptr error_;
+};
+
+#endif
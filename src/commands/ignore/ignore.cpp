@@ -0,0 +1,377 @@
+#include "ignore.h"
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+using namespace std;
+
+// Past this many DFA states the NFA is simulated instead
+static const size_t MAX_DFA_STATES = 4096;
+
+vector<string> ignore_read_rules(const string &path) {
+    vector<string> rules;
+    ifstream file(path);
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        rules.push_back(line);
+    }
+    return rules;
+}
+
+void IgnoreMatcher::Hits::add(int32_t rule, bool dirOnly) {
+    dirs = max(dirs, rule);
+    if (!dirOnly) files = max(files, rule);
+}
+
+// ----------------- Parsing -----------------
+
+// Parse a [...] class starting at pattern[i]; false if it is not closed
+static bool parse_class(string_view pattern, size_t &i, bitset<256> &set) {
+    size_t j = i + 1;
+    bool negate = j < pattern.size() && (pattern[j] == '!' || pattern[j] == '^');
+    if (negate) ++j;
+    bool first = true;
+    while (j < pattern.size() && (pattern[j] != ']' || first)) {
+        first = false;
+        unsigned char lo = static_cast<unsigned char>(pattern[j]);
+        if (lo == '\\' && j + 1 < pattern.size()) lo = static_cast<unsigned char>(pattern[++j]);
+        unsigned char hi = lo;
+        if (j + 2 < pattern.size() && pattern[j + 1] == '-' && pattern[j + 2] != ']') {
+            j += 2;
+            hi = static_cast<unsigned char>(pattern[j]);
+            if (hi == '\\' && j + 1 < pattern.size()) hi = static_cast<unsigned char>(pattern[++j]);
+        }
+        for (unsigned c = lo; c <= hi; ++c) set.set(c);
+        ++j;
+    }
+    if (j >= pattern.size()) return false;
+    if (negate) set.flip();
+    set.reset('/');
+    i = j + 1;
+    return true;
+}
+
+static void tokenize(string_view pattern, vector<IgnoreMatcher::Token> &tokens, vector<bitset<256>> &classes) {
+    using Kind = IgnoreMatcher::TokenKind;
+    auto push = [&](Kind kind, char ch = 0, uint16_t charClass = 0) {
+        // runs of * match the same as one
+        if (kind == Kind::Star && !tokens.empty() && tokens.back().kind == Kind::Star) return;
+        tokens.push_back(IgnoreMatcher::Token{ kind, ch, charClass });
+    };
+
+    size_t i = 0;
+    while (i < pattern.size()) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            push(Kind::Literal, pattern[i + 1]);
+            i += 2;
+        } else if (c == '*') {
+            size_t end = i;
+            while (end < pattern.size() && pattern[end] == '*') ++end;
+            // ** is special only as a whole path component
+            bool ownComponent = end - i >= 2 && (i == 0 || pattern[i - 1] == '/');
+            if (ownComponent && end == pattern.size()) {
+                push(Kind::AnyPath);
+                i = end;
+            } else if (ownComponent && pattern[end] == '/') {
+                push(Kind::AnyDirs);
+                i = end + 1;
+            } else {
+                push(Kind::Star);
+                i = end;
+            }
+        } else if (c == '?') {
+            push(Kind::AnyChar);
+            ++i;
+        } else if (c == '[') {
+            bitset<256> set;
+            size_t next = i;
+            if (parse_class(pattern, next, set)) {
+                auto found = find(classes.begin(), classes.end(), set);
+                size_t index = size_t(found - classes.begin());
+                if (found == classes.end()) classes.push_back(set);
+                push(Kind::Class, 0, uint16_t(index));
+                i = next;
+            } else {
+                push(Kind::Literal, c);
+                ++i;
+            }
+        } else {
+            push(Kind::Literal, c);
+            ++i;
+        }
+    }
+}
+
+static bool all_literal(const vector<IgnoreMatcher::Token> &tokens, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+        if (tokens[i].kind != IgnoreMatcher::TokenKind::Literal) return false;
+    }
+    return true;
+}
+
+static string literal_text(const vector<IgnoreMatcher::Token> &tokens, size_t begin, size_t end) {
+    string text;
+    for (size_t i = begin; i < end; ++i) text += tokens[i].ch;
+    return text;
+}
+
+void IgnoreMatcher::addRule(string line) {
+    // trailing spaces are dropped unless escaped
+    while (!line.empty() && line.back() == ' ' && !(line.size() >= 2 && line[line.size() - 2] == '\\'))
+        line.pop_back();
+    if (line.empty() || line[0] == '#') return;
+
+    bool negated = false;
+    if (line[0] == '!') {
+        negated = true;
+        line.erase(0, 1);
+    }
+    bool dirOnly = false;
+    if (!line.empty() && line.back() == '/') {
+        dirOnly = true;
+        line.pop_back();
+    }
+    bool anchored = line.find('/') != string::npos;
+    if (!line.empty() && line[0] == '/') line.erase(0, 1);
+    if (line.empty()) return;
+
+    vector<Token> tokens;
+    tokenize(line, tokens, classes_);
+
+    int32_t rule = int32_t(negated_.size());
+    negated_.push_back(negated);
+
+    auto addKey = [&](unordered_map<string_view, Hits> &table, string key) {
+        strings_.push_back(std::move(key));
+        table[strings_.back()].add(rule, dirOnly);
+    };
+
+    size_t n = tokens.size();
+    if (all_literal(tokens, 0, n)) {
+        addKey(anchored ? paths_ : names_, literal_text(tokens, 0, n));
+    } else if (!anchored && tokens[0].kind == TokenKind::Star && all_literal(tokens, 1, n)) {
+        addKey(suffixes_, literal_text(tokens, 1, n));
+        suffixLengths_.push_back(n - 1);
+    } else if (!anchored && tokens[n - 1].kind == TokenKind::Star && all_literal(tokens, 0, n - 1)) {
+        addKey(prefixes_, literal_text(tokens, 0, n - 1));
+        prefixLengths_.push_back(n - 1);
+    } else {
+        Automaton &automaton = anchored ? pathGlobs_ : nameGlobs_;
+        automaton.patterns.push_back(std::move(tokens));
+        automaton.rules.push_back(rule);
+        automaton.dirOnly.push_back(dirOnly);
+    }
+}
+
+IgnoreMatcher::IgnoreMatcher(const vector<string> &rules) {
+    for (const string &line : rules) addRule(line);
+    for (vector<size_t> *lengths : { &suffixLengths_, &prefixLengths_ }) {
+        sort(lengths->begin(), lengths->end());
+        lengths->erase(unique(lengths->begin(), lengths->end()), lengths->end());
+    }
+    compile(nameGlobs_);
+    compile(pathGlobs_);
+}
+
+// ----------------- Glob automaton -----------------
+
+void IgnoreMatcher::closure(const Automaton &automaton, vector<uint32_t> &states) const {
+    // Star, AnyPath and AnyDirs may match nothing: entering one also enters
+    // the token after it
+    for (size_t i = 0; i < states.size(); ++i) {
+        uint32_t id = states[i];
+        uint32_t p = automaton.statePattern[id];
+        uint32_t pos = automaton.statePos[id];
+        bool inside = (id - automaton.stateBase[p]) & 1;
+        const vector<Token> &tokens = automaton.patterns[p];
+        if (inside || pos == tokens.size()) continue;
+        TokenKind kind = tokens[pos].kind;
+        if (kind == TokenKind::Star || kind == TokenKind::AnyPath || kind == TokenKind::AnyDirs)
+            states.push_back(id + 2);
+    }
+    sort(states.begin(), states.end());
+    states.erase(unique(states.begin(), states.end()), states.end());
+}
+
+void IgnoreMatcher::step(const Automaton &automaton, const vector<uint32_t> &from, unsigned char c,
+                         vector<uint32_t> &to) const {
+    to.clear();
+    for (uint32_t id : from) {
+        uint32_t p = automaton.statePattern[id];
+        uint32_t pos = automaton.statePos[id];
+        const vector<Token> &tokens = automaton.patterns[p];
+        if (pos == tokens.size()) continue;
+        uint32_t here = automaton.stateBase[p] + 2 * pos;
+        uint32_t next = here + 2;
+        const Token &token = tokens[pos];
+        switch (token.kind) {
+        case TokenKind::Literal:
+            if (c == static_cast<unsigned char>(token.ch)) to.push_back(next);
+            break;
+        case TokenKind::AnyChar:
+            if (c != '/') to.push_back(next);
+            break;
+        case TokenKind::Class:
+            if (c != '/' && classes_[token.charClass][c]) to.push_back(next);
+            break;
+        case TokenKind::Star:
+            if (c != '/') to.push_back(here);
+            break;
+        case TokenKind::AnyPath:
+            to.push_back(here);
+            break;
+        case TokenKind::AnyDirs:
+            // inside "**/": any run of characters, left after a '/'
+            if (c == '/') to.push_back(next);
+            to.push_back(here + 1);
+            break;
+        }
+    }
+    closure(automaton, to);
+}
+
+IgnoreMatcher::Hits IgnoreMatcher::acceptOf(const Automaton &automaton, const vector<uint32_t> &states) const {
+    Hits hits;
+    for (uint32_t id : states) {
+        uint32_t p = automaton.statePattern[id];
+        if (automaton.statePos[id] == automaton.patterns[p].size())
+            hits.add(automaton.rules[p], automaton.dirOnly[p]);
+    }
+    return hits;
+}
+
+void IgnoreMatcher::compile(Automaton &automaton) {
+    if (automaton.patterns.empty()) return;
+
+    for (uint32_t p = 0; p < automaton.patterns.size(); ++p) {
+        automaton.stateBase.push_back(uint32_t(automaton.statePattern.size()));
+        for (uint32_t pos = 0; pos <= automaton.patterns[p].size(); ++pos) {
+            for (int inside = 0; inside < 2; ++inside) {
+                automaton.statePattern.push_back(p);
+                automaton.statePos.push_back(pos);
+            }
+        }
+    }
+
+    // Bytes that no token tells apart share a class
+    vector<bitset<256>> sets;
+    bitset<256> slash;
+    slash.set('/');
+    sets.push_back(slash);
+    for (const vector<Token> &tokens : automaton.patterns) {
+        for (const Token &token : tokens) {
+            if (token.kind == TokenKind::Literal) {
+                bitset<256> one;
+                one.set(static_cast<unsigned char>(token.ch));
+                sets.push_back(one);
+            } else if (token.kind == TokenKind::Class) {
+                sets.push_back(classes_[token.charClass]);
+            }
+        }
+    }
+    map<vector<bool>, int> signatures;
+    int representative[256];
+    for (int b = 0; b < 256; ++b) {
+        vector<bool> signature(sets.size());
+        for (size_t s = 0; s < sets.size(); ++s) signature[s] = sets[s][b];
+        auto inserted = signatures.emplace(signature, int(signatures.size()));
+        automaton.byteClass[b] = uint8_t(inserted.first->second);
+        if (inserted.second) representative[inserted.first->second] = b;
+    }
+    // more than 256 classes cannot happen: there are only 256 bytes
+    automaton.classCount = int(signatures.size());
+
+    for (uint32_t p = 0; p < automaton.patterns.size(); ++p) automaton.startSet.push_back(automaton.stateBase[p]);
+    closure(automaton, automaton.startSet);
+
+    // Subset construction; DFA state 0 is the dead (empty) set
+    map<vector<uint32_t>, int32_t> ids;
+    vector<vector<uint32_t>> dfaStates;
+    auto intern = [&](const vector<uint32_t> &states) {
+        auto found = ids.find(states);
+        if (found != ids.end()) return found->second;
+        int32_t id = int32_t(dfaStates.size());
+        ids.emplace(states, id);
+        dfaStates.push_back(states);
+        return id;
+    };
+    intern(vector<uint32_t>());
+    automaton.startState = intern(automaton.startSet);
+
+    vector<uint32_t> next;
+    for (size_t s = 0; s < dfaStates.size(); ++s) {
+        if (dfaStates.size() > MAX_DFA_STATES) {
+            automaton.useNfa = true;
+            automaton.transitions.clear();
+            automaton.accept.clear();
+            return;
+        }
+        automaton.transitions.resize((s + 1) * automaton.classCount, 0);
+        for (int c = 0; c < automaton.classCount; ++c) {
+            step(automaton, dfaStates[s], static_cast<unsigned char>(representative[c]), next);
+            automaton.transitions[s * automaton.classCount + c] = next.empty() ? 0 : intern(next);
+        }
+    }
+    for (const vector<uint32_t> &states : dfaStates) automaton.accept.push_back(acceptOf(automaton, states));
+}
+
+IgnoreMatcher::Hits IgnoreMatcher::run(const Automaton &automaton, string_view input) const {
+    if (automaton.startState < 0) return Hits();
+
+    if (automaton.useNfa) {
+        vector<uint32_t> current = automaton.startSet;
+        vector<uint32_t> next;
+        for (char c : input) {
+            step(automaton, current, static_cast<unsigned char>(c), next);
+            if (next.empty()) return Hits();
+            current.swap(next);
+        }
+        return acceptOf(automaton, current);
+    }
+
+    int32_t state = automaton.startState;
+    for (char c : input) {
+        state = automaton.transitions[size_t(state) * automaton.classCount +
+                                      automaton.byteClass[static_cast<unsigned char>(c)]];
+        if (state == 0) return Hits();
+    }
+    return automaton.accept[state];
+}
+
+// ----------------- Matching -----------------
+
+bool IgnoreMatcher::matches(string_view path, bool isDir) const {
+    size_t slash = path.rfind('/');
+    string_view name = slash == string_view::npos ? path : path.substr(slash + 1);
+
+    int32_t best = -1;
+    auto consider = [&](const Hits &hits) { best = max(best, hits.get(isDir)); };
+    auto lookup = [&](const unordered_map<string_view, Hits> &table, string_view key) {
+        auto found = table.find(key);
+        if (found != table.end()) consider(found->second);
+    };
+
+    lookup(names_, name);
+    lookup(paths_, path);
+    for (size_t length : suffixLengths_) {
+        if (length > name.size()) break;
+        lookup(suffixes_, name.substr(name.size() - length));
+    }
+    for (size_t length : prefixLengths_) {
+        if (length > name.size()) break;
+        lookup(prefixes_, name.substr(0, length));
+    }
+    consider(run(nameGlobs_, name));
+    consider(run(pathGlobs_, path));
+
+    return best >= 0 && !negated_[best];
+}
+
+bool IgnoreMatcher::ignored(string_view path, bool isDir) const {
+    for (size_t slash = path.find('/'); slash != string_view::npos; slash = path.find('/', slash + 1)) {
+        if (matches(path.substr(0, slash), true)) return true;
+    }
+    return matches(path, isDir);
+}
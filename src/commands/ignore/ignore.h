@@ -0,0 +1,104 @@
+#ifndef IGNORE_H
+#define IGNORE_H
+
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// .mintvcsignore rules, with gitignore semantics:
+//   - blank lines and lines starting with # are skipped; \# and \! escape
+//   - a leading ! re-includes what an earlier rule excluded; the last rule
+//     that matches a path decides
+//   - a trailing / matches directories only
+//   - a rule containing another / is anchored and matched against the whole
+//     path from the repository root (a leading / only anchors); any other
+//     rule is matched against the last path component at every depth
+//   - * and ? match within one component, [...] is a character class;
+//     **/ matches zero or more directories and a trailing /** everything below
+//
+// Rules are compiled once: literal names and paths, "*suffix" and "prefix*"
+// rules are hash lookups, and all other globs are merged into one DFA for
+// names and one for paths, so matching a path costs about the same whatever
+// the number of rules. A compiled matcher is read-only and safe to share
+// between threads.
+
+// The lines of an ignore file; empty if it does not exist
+std::vector<std::string> ignore_read_rules(const std::string &path);
+
+class IgnoreMatcher {
+public:
+    explicit IgnoreMatcher(const std::vector<std::string> &rules);
+
+    // Whether path itself is ignored, its parent directories being known not
+    // to be. This is the check for a walk that prunes ignored directories.
+    bool matches(std::string_view path, bool isDir) const;
+    // Whether path or any directory above it is ignored
+    bool ignored(std::string_view path, bool isDir) const;
+
+    // A rule compiled for the glob automaton. AnyPath is a trailing "**",
+    // AnyDirs a "**/" that matches zero or more leading directories.
+    enum class TokenKind : uint8_t { Literal, AnyChar, Class, Star, AnyPath, AnyDirs };
+    struct Token {
+        TokenKind kind;
+        char ch;             // Literal
+        uint16_t charClass;  // Class: index into the matcher's class table
+    };
+
+private:
+    // Best matching rule, as a rule number, per kind of entry: any rule can
+    // match a directory, only rules without a trailing / match a file
+    struct Hits {
+        int32_t dirs = -1;
+        int32_t files = -1;
+        void add(int32_t rule, bool dirOnly);
+        int32_t get(bool isDir) const { return isDir ? dirs : files; }
+    };
+
+    // Globs merged into one automaton over byte classes. The DFA is built up
+    // front; if it would grow too large the NFA is simulated instead.
+    struct Automaton {
+        std::vector<std::vector<Token>> patterns;
+        std::vector<int32_t> rules;
+        std::vector<bool> dirOnly;
+
+        // NFA state = (pattern, token position, inside "**/" flag)
+        std::vector<uint32_t> stateBase;
+        std::vector<uint32_t> statePattern;
+        std::vector<uint32_t> statePos;
+
+        uint8_t byteClass[256] = {};
+        int classCount = 1;
+        int startState = -1;               // -1: no patterns
+        std::vector<uint32_t> startSet;
+        std::vector<int32_t> transitions;  // DFA state * classCount; state 0 is dead
+        std::vector<Hits> accept;
+        bool useNfa = false;
+    };
+
+    void addRule(std::string line);
+    void compile(Automaton &automaton);
+    Hits run(const Automaton &automaton, std::string_view input) const;
+    void closure(const Automaton &automaton, std::vector<uint32_t> &states) const;
+    void step(const Automaton &automaton, const std::vector<uint32_t> &from, unsigned char c,
+              std::vector<uint32_t> &to) const;
+    Hits acceptOf(const Automaton &automaton, const std::vector<uint32_t> &states) const;
+
+    std::deque<std::string> strings_;  // owns the table keys below
+    std::vector<bool> negated_;
+    std::vector<std::bitset<256>> classes_;
+
+    std::unordered_map<std::string_view, Hits> names_;
+    std::unordered_map<std::string_view, Hits> paths_;
+    std::unordered_map<std::string_view, Hits> suffixes_;
+    std::unordered_map<std::string_view, Hits> prefixes_;
+    std::vector<size_t> suffixLengths_;
+    std::vector<size_t> prefixLengths_;
+    Automaton nameGlobs_;
+    Automaton pathGlobs_;
+};
+
+#endif
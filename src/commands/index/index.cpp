@@ -0,0 +1,693 @@
+#include "index.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "../hash_object/mapped_file.h"
+#include "../hash_object/sha1.h"
+#include "../config/config.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char INDEX_MAGIC[4] = { 'M', 'N', 'D', 'X' };
+static const uint32_t INDEX_VERSION = 2;
+static const size_t INDEX_HEADER_SIZE = 12;
+// Fixed part of an entry, before the path
+static const size_t ENTRY_FIXED_SIZE = 16 + 16 + 4 + 8 + 20 + 2;
+static const char EXT_TREE[4] = { 'T', 'R', 'E', 'E' };
+static const char EXT_LINK[4] = { 'L', 'I', 'N', 'K' };
+static const char EXT_FSMONITOR[4] = { 'F', 'S', 'M', 'N' };
+static const char EXT_UNTRACKED[4] = { 'U', 'N', 'T', 'R' };
+// Coarsest mtime granularity we allow for (FAT stores 2-second times)
+static const uint64_t RACY_MARGIN_NS = 2000000000ULL;
+
+static uint64_t now_ns();
+// Files modified after this may have been stat'ed in the same tick they changed
+static const uint64_t PROCESS_START_NS = now_ns();
+
+static uint64_t mtime_ns(const IndexStat &st) {
+    return uint64_t(st.mtimeSec) * 1000000000ULL + st.mtimeNsec;
+}
+
+static uint64_t read_be(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+static void put_be(vector<uint8_t> &out, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; --i) out.push_back(uint8_t(v >> (8 * i)));
+}
+
+static string trim(const string &s) {
+    size_t start = s.find_first_not_of(" \t\r\n");
+    if (start == string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(start, end - start + 1);
+}
+
+static bool path_less(const IndexEntry &a, const IndexEntry &b) {
+    return a.path < b.path;
+}
+
+// Sort a run by path and drop all but the last entry for each path
+static void sort_run(vector<IndexEntry> &run) {
+    if (!is_sorted(run.begin(), run.end(), path_less))
+        stable_sort(run.begin(), run.end(), path_less);
+    size_t out = 0;
+    for (size_t i = 0; i < run.size(); ++i) {
+        if (i + 1 < run.size() && run[i + 1].path == run[i].path) continue;
+        if (out != i) run[out] = std::move(run[i]);
+        ++out;
+    }
+    run.resize(out);
+}
+
+// Octal mode as stored in the tree, e.g. 0100644 -> "100644"
+static string format_mode(uint32_t mode) {
+    char buf[12];
+    char *p = buf + sizeof(buf);
+    do {
+        *--p = char('0' + (mode & 7));
+        mode >>= 3;
+    } while (mode);
+    return string(p, buf + sizeof(buf) - p);
+}
+
+// ----------------- Cached tree -----------------
+
+CachedTree *CachedTree::child(string_view childName) {
+    for (CachedTree &c : children) {
+        if (c.name == childName) return &c;
+    }
+    return nullptr;
+}
+
+const CachedTree *CachedTree::child(string_view childName) const {
+    return const_cast<CachedTree *>(this)->child(childName);
+}
+
+static void read_cached_tree(const uint8_t *&p, const uint8_t *end, CachedTree &node, int depth) {
+    if (depth > 4096) throw runtime_error("Cached tree too deep");
+    const uint8_t *nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+    if (!nul || size_t(end - nul) < 1 + 8) throw runtime_error("Truncated cached tree");
+    node.name.assign(reinterpret_cast<const char*>(p), size_t(nul - p));
+    p = nul + 1;
+    node.entryCount = int32_t(uint32_t(read_be(p, 4)));
+    uint32_t childCount = uint32_t(read_be(p + 4, 4));
+    p += 8;
+    if (node.valid()) {
+        if (end - p < 20) throw runtime_error("Truncated cached tree");
+        memcpy(node.oid.bytes, p, 20);
+        p += 20;
+    }
+    for (uint32_t i = 0; i < childCount; ++i) {
+        if (p >= end) throw runtime_error("Truncated cached tree");
+        node.children.emplace_back();
+        read_cached_tree(p, end, node.children.back(), depth + 1);
+    }
+}
+
+static void write_cached_tree(vector<uint8_t> &out, const CachedTree &node) {
+    out.insert(out.end(), node.name.begin(), node.name.end());
+    out.push_back(0);
+    put_be(out, uint32_t(node.entryCount), 4);
+    put_be(out, node.children.size(), 4);
+    if (node.valid()) out.insert(out.end(), node.oid.bytes, node.oid.bytes + 20);
+    for (const CachedTree &c : node.children) write_cached_tree(out, c);
+}
+
+// ----------------- Untracked cache -----------------
+
+static void read_untracked_dir(const uint8_t *&p, const uint8_t *end, UntrackedDir &dir, int depth) {
+    if (depth > 4096) throw runtime_error("Untracked cache too deep");
+    const uint8_t *nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+    if (!nul || end - nul < 2) throw runtime_error("Truncated untracked cache");
+    dir.name.assign(reinterpret_cast<const char*>(p), size_t(nul - p));
+    dir.listed = nul[1] != 0;
+    p = nul + 2;
+    if (dir.listed) {
+        if (end - p < 32 + 4) throw runtime_error("Truncated untracked cache");
+        dir.stat.ctimeSec = uint32_t(read_be(p, 4));
+        dir.stat.ctimeNsec = uint32_t(read_be(p + 4, 4));
+        dir.stat.mtimeSec = uint32_t(read_be(p + 8, 4));
+        dir.stat.mtimeNsec = uint32_t(read_be(p + 12, 4));
+        dir.stat.dev = read_be(p + 16, 8);
+        dir.stat.ino = read_be(p + 24, 8);
+        uint32_t fileCount = uint32_t(read_be(p + 32, 4));
+        p += 36;
+        for (uint32_t i = 0; i < fileCount; ++i) {
+            nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+            if (!nul) throw runtime_error("Truncated untracked cache");
+            dir.files.emplace_back(reinterpret_cast<const char*>(p), size_t(nul - p));
+            p = nul + 1;
+        }
+    }
+    if (end - p < 4) throw runtime_error("Truncated untracked cache");
+    uint32_t childCount = uint32_t(read_be(p, 4));
+    p += 4;
+    for (uint32_t i = 0; i < childCount; ++i) {
+        if (p >= end) throw runtime_error("Truncated untracked cache");
+        dir.children.emplace_back();
+        read_untracked_dir(p, end, dir.children.back(), depth + 1);
+    }
+}
+
+static void write_untracked_dir(vector<uint8_t> &out, const UntrackedDir &dir) {
+    out.insert(out.end(), dir.name.begin(), dir.name.end());
+    out.push_back(0);
+    out.push_back(dir.listed ? 1 : 0);
+    if (dir.listed) {
+        put_be(out, dir.stat.ctimeSec, 4);
+        put_be(out, dir.stat.ctimeNsec, 4);
+        put_be(out, dir.stat.mtimeSec, 4);
+        put_be(out, dir.stat.mtimeNsec, 4);
+        put_be(out, dir.stat.dev, 8);
+        put_be(out, dir.stat.ino, 8);
+        put_be(out, dir.files.size(), 4);
+        for (const string &file : dir.files) {
+            out.insert(out.end(), file.begin(), file.end());
+            out.push_back(0);
+        }
+    }
+    put_be(out, dir.children.size(), 4);
+    for (const UntrackedDir &child : dir.children) write_untracked_dir(out, child);
+}
+
+// ----------------- Reading -----------------
+
+// Version 1 lines may be in any order and repeat a path; the last one wins
+static void read_text_index(const uint8_t *data, size_t size, vector<IndexEntry> &out) {
+    istringstream in(string(reinterpret_cast<const char*>(data), size));
+    string line;
+    while (getline(in, line)) {
+        if (line.empty()) continue;
+        istringstream ss(line);
+        IndexEntry entry;
+        string type, oid;
+        if (!(ss >> entry.mode >> type >> oid) || !ObjectId::parse(oid, entry.oid)) continue;
+        getline(ss, entry.path);
+        entry.path = trim(entry.path);
+        if (!entry.path.empty()) out.push_back(std::move(entry));
+    }
+    sort_run(out);
+}
+
+// What a split index's "LINK" extension says about its base
+struct IndexLink {
+    bool present = false;
+    ObjectId base;
+    vector<string> removed;
+};
+
+// The extensions of one index file
+struct IndexExtensions {
+    CachedTree cacheTree;
+    IndexLink link;
+    IndexFsmonitor fsmonitor;
+    UntrackedCache untracked;
+};
+
+static void read_link(const uint8_t *p, const uint8_t *end, IndexLink &link) {
+    if (end - p < 24) throw runtime_error("Truncated index link");
+    link.present = true;
+    memcpy(link.base.bytes, p, 20);
+    uint32_t count = uint32_t(read_be(p + 20, 4));
+    p += 24;
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint8_t *nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+        if (!nul) throw runtime_error("Truncated index link");
+        link.removed.emplace_back(reinterpret_cast<const char*>(p), size_t(nul - p));
+        p = nul + 1;
+    }
+}
+
+static void read_fsmonitor(const uint8_t *p, const uint8_t *end, IndexFsmonitor &fsmonitor) {
+    const uint8_t *nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+    if (!nul || end - nul < 5) throw runtime_error("Truncated index fsmonitor state");
+    fsmonitor.token.assign(reinterpret_cast<const char*>(p), size_t(nul - p));
+    uint32_t count = uint32_t(read_be(nul + 1, 4));
+    p = nul + 5;
+    for (uint32_t i = 0; i < count; ++i) {
+        nul = static_cast<const uint8_t*>(memchr(p, 0, size_t(end - p)));
+        if (!nul) throw runtime_error("Truncated index fsmonitor state");
+        fsmonitor.dirty.emplace_back(reinterpret_cast<const char*>(p), size_t(nul - p));
+        p = nul + 1;
+    }
+    sort(fsmonitor.dirty.begin(), fsmonitor.dirty.end());
+}
+
+static void read_binary_index(const uint8_t *data, size_t size, vector<IndexEntry> &out,
+                              IndexExtensions &extensions) {
+    if (size < INDEX_HEADER_SIZE + 20 || read_be(data + 4, 4) != INDEX_VERSION)
+        throw runtime_error("Unsupported index version");
+
+    SHA1_CTX ctx;
+    sha1_init(ctx);
+    sha1_update(ctx, data, size - 20);
+    uint8_t sum[20];
+    sha1_final(ctx, sum);
+    if (memcmp(sum, data + size - 20, 20) != 0) throw runtime_error("Index checksum mismatch");
+
+    uint32_t count = uint32_t(read_be(data + 8, 4));
+    const uint8_t *p = data + INDEX_HEADER_SIZE;
+    const uint8_t *end = data + size - 20;
+    // a bad count must not over-reserve: every entry takes more than the fixed part
+    out.reserve(min<size_t>(count, size / (ENTRY_FIXED_SIZE + 1)));
+    for (uint32_t i = 0; i < count; ++i) {
+        if (size_t(end - p) < ENTRY_FIXED_SIZE) throw runtime_error("Truncated index entry");
+        out.emplace_back();
+        IndexEntry &entry = out.back();
+        entry.stat.ctimeSec = uint32_t(read_be(p, 4));
+        entry.stat.ctimeNsec = uint32_t(read_be(p + 4, 4));
+        entry.stat.mtimeSec = uint32_t(read_be(p + 8, 4));
+        entry.stat.mtimeNsec = uint32_t(read_be(p + 12, 4));
+        entry.stat.dev = read_be(p + 16, 8);
+        entry.stat.ino = read_be(p + 24, 8);
+        entry.mode = format_mode(uint32_t(read_be(p + 32, 4)));
+        entry.stat.size = read_be(p + 36, 8);
+        memcpy(entry.oid.bytes, p + 44, 20);
+        size_t pathLen = size_t(read_be(p + 64, 2));
+
+        size_t entryLen = (ENTRY_FIXED_SIZE + pathLen + 1 + 7) & ~size_t(7);
+        if (size_t(end - p) < entryLen) throw runtime_error("Truncated index entry");
+        entry.path.assign(reinterpret_cast<const char*>(p + ENTRY_FIXED_SIZE), pathLen);
+        // the writer emits paths in strictly increasing order
+        if (i > 0 && !(out[i - 1].path < entry.path)) throw runtime_error("Index entries out of order");
+        p += entryLen;
+    }
+
+    while (p < end) {
+        if (end - p < 8) throw runtime_error("Truncated index extension");
+        size_t len = size_t(read_be(p + 4, 4));
+        const uint8_t *ext = p + 8;
+        if (size_t(end - ext) < len) throw runtime_error("Truncated index extension");
+        if (memcmp(p, EXT_TREE, 4) == 0) {
+            const uint8_t *q = ext;
+            read_cached_tree(q, ext + len, extensions.cacheTree, 0);
+        } else if (memcmp(p, EXT_LINK, 4) == 0) {
+            read_link(ext, ext + len, extensions.link);
+        } else if (memcmp(p, EXT_FSMONITOR, 4) == 0) {
+            read_fsmonitor(ext, ext + len, extensions.fsmonitor);
+        } else if (memcmp(p, EXT_UNTRACKED, 4) == 0) {
+            if (len < 20) throw runtime_error("Truncated untracked cache");
+            UntrackedCache &untracked = extensions.untracked;
+            untracked.present = true;
+            memcpy(untracked.rulesId.bytes, ext, 20);
+            const uint8_t *q = ext + 20;
+            const uint8_t *nul = static_cast<const uint8_t*>(memchr(q, 0, size_t(ext + len - q)));
+            if (!nul) throw runtime_error("Truncated untracked cache");
+            untracked.token.assign(reinterpret_cast<const char*>(q), size_t(nul - q));
+            q = nul + 1;
+            read_untracked_dir(q, ext + len, untracked.root, 0);
+        }
+        p = ext + len;
+    }
+}
+
+// Read one index file, either version; false if it does not exist
+static bool read_index_file(const string &path, vector<IndexEntry> &entries, IndexExtensions &extensions) {
+    MappedFile file;
+    if (!file.open(path)) return false;
+
+    if (file.size() >= 4 && memcmp(file.data(), INDEX_MAGIC, 4) == 0)
+        read_binary_index(file.data(), file.size(), entries, extensions);
+    else
+        read_text_index(file.data(), file.size(), entries);
+
+    // racy against the index file itself: the stat data proves nothing
+    IndexStat self;
+    if (index_stat_file(path, self)) {
+        for (IndexEntry &entry : entries) {
+            if (!entry.stat.empty() && mtime_ns(entry.stat) >= mtime_ns(self)) entry.stat = IndexStat();
+        }
+    }
+    return true;
+}
+
+static string shared_index_path(const string &indexPath, const ObjectId &base) {
+    return (fs::path(indexPath).parent_path() / ("sharedindex." + base.hex())).string();
+}
+
+void Index::load(const string &path) {
+    entries_.clear();
+    base_.clear();
+    baseId_ = ObjectId();
+
+    IndexExtensions extensions;
+    bool found = read_index_file(path, entries_, extensions);
+    cacheTree_ = std::move(extensions.cacheTree);
+    fsmonitor_ = std::move(extensions.fsmonitor);
+    untrackedCache_ = std::move(extensions.untracked);
+    const IndexLink &link = extensions.link;
+    if (!found || !link.present) return;
+
+    // Split index: the entries read so far are changes on top of the base
+    IndexExtensions baseExtensions;
+    if (!read_index_file(shared_index_path(path, link.base), base_, baseExtensions) ||
+        baseExtensions.link.present)
+        throw runtime_error("Missing shared index " + link.base.hex());
+    baseId_ = link.base;
+
+    vector<IndexEntry> changes = std::move(entries_);
+    vector<string> removed = link.removed;
+    sort(removed.begin(), removed.end());
+    entries_.clear();
+    entries_.reserve(base_.size() + changes.size());
+    size_t a = 0, b = 0;
+    while (a < base_.size() || b < changes.size()) {
+        if (b == changes.size() || (a < base_.size() && base_[a].path < changes[b].path)) {
+            if (!binary_search(removed.begin(), removed.end(), base_[a].path))
+                entries_.push_back(base_[a]);
+            ++a;
+        } else {
+            if (a < base_.size() && base_[a].path == changes[b].path) ++a;
+            entries_.push_back(std::move(changes[b++]));
+        }
+    }
+}
+
+// ----------------- Lookup and update -----------------
+
+bool IndexFsmonitor::is_dirty(string_view path) const {
+    return binary_search(dirty.begin(), dirty.end(), path,
+                         [](string_view a, string_view b) { return a < b; });
+}
+
+IndexEntry *Index::find(string_view path) {
+    auto it = lower_bound(entries_.begin(), entries_.end(), path,
+                          [](const IndexEntry &e, string_view p) { return e.path < p; });
+    if (it == entries_.end() || it->path != path) return nullptr;
+    return &*it;
+}
+
+const IndexEntry *Index::find(string_view path) const {
+    return const_cast<Index *>(this)->find(path);
+}
+
+void Index::merge(vector<IndexEntry> run) {
+    sort_run(run);
+    if (run.empty()) return;
+    if (entries_.empty()) {
+        entries_ = std::move(run);
+        cacheTree_.entryCount = -1;
+        cacheTree_.children.clear();
+        return;
+    }
+
+    vector<IndexEntry> merged;
+    merged.reserve(entries_.size() + run.size());
+    size_t a = 0, b = 0;
+    while (a < entries_.size() || b < run.size()) {
+        if (b == run.size() || (a < entries_.size() && entries_[a].path < run[b].path)) {
+            merged.push_back(std::move(entries_[a++]));
+        } else {
+            bool same = false;
+            if (a < entries_.size() && entries_[a].path == run[b].path) {
+                same = entries_[a].oid == run[b].oid && entries_[a].mode == run[b].mode;
+                ++a;
+            }
+            if (!same) invalidate_path(run[b].path);
+            merged.push_back(std::move(run[b++]));
+        }
+    }
+    entries_ = std::move(merged);
+}
+
+bool index_range_is_dir(const vector<IndexEntry> &entries, size_t start, size_t count, string_view dir) {
+    string prefix(dir);
+    if (!prefix.empty()) prefix += '/';
+    auto under = [&](size_t i) { return entries[i].path.compare(0, prefix.size(), prefix) == 0; };
+    if (count == 0 || start + count > entries.size()) return false;
+    if (!under(start) || !under(start + count - 1)) return false;
+    return start + count == entries.size() || !under(start + count);
+}
+
+void Index::invalidate_path(string_view path) {
+    CachedTree *node = &cacheTree_;
+    while (node) {
+        node->entryCount = -1;
+        size_t slash = path.find('/');
+        if (slash == string_view::npos) break;
+        node = node->child(path.substr(0, slash));
+        path.remove_prefix(slash + 1);
+    }
+}
+
+// ----------------- Writing -----------------
+
+static const IndexStat NO_STAT;
+
+// Stat data as save() stores it. An entry stat'ed by this process may have
+// been stat'ed in the tick its file changed; once a newer index exists load()
+// could no longer tell, so that stat data is dropped here.
+static const IndexStat &stored_stat(const IndexEntry &entry) {
+    return mtime_ns(entry.stat) + RACY_MARGIN_NS >= PROCESS_START_NS ? NO_STAT : entry.stat;
+}
+
+static bool same_stat(const IndexStat &a, const IndexStat &b) {
+    return a.ctimeSec == b.ctimeSec && a.ctimeNsec == b.ctimeNsec && a.mtimeSec == b.mtimeSec &&
+           a.mtimeNsec == b.mtimeNsec && a.dev == b.dev && a.ino == b.ino && a.size == b.size;
+}
+
+static void begin_extension(vector<uint8_t> &out, const char signature[4], size_t &lenAt) {
+    out.insert(out.end(), signature, signature + 4);
+    lenAt = out.size();
+    put_be(out, 0, 4);
+}
+
+static void end_extension(vector<uint8_t> &out, size_t lenAt) {
+    uint64_t len = out.size() - lenAt - 4;
+    for (int i = 0; i < 4; ++i) out[lenAt + i] = uint8_t(len >> (8 * (3 - i)));
+}
+
+// The extensions save() writes; null ones are left out
+struct IndexExtensionsOut {
+    const CachedTree *cacheTree = nullptr;
+    const IndexLink *link = nullptr;
+    const IndexFsmonitor *fsmonitor = nullptr;
+    const UntrackedCache *untracked = nullptr;
+};
+
+// Serialize entries and extensions, including the trailing checksum
+static vector<uint8_t> encode_index(const vector<const IndexEntry*> &entries, const IndexExtensionsOut &extensions) {
+    vector<uint8_t> out(INDEX_MAGIC, INDEX_MAGIC + 4);
+    put_be(out, INDEX_VERSION, 4);
+    put_be(out, entries.size(), 4);
+    for (const IndexEntry *entry : entries) {
+        if (entry->path.size() > 0xFFFF) throw runtime_error("Path too long for index: " + entry->path);
+        const IndexStat &st = stored_stat(*entry);
+        size_t start = out.size();
+        put_be(out, st.ctimeSec, 4);
+        put_be(out, st.ctimeNsec, 4);
+        put_be(out, st.mtimeSec, 4);
+        put_be(out, st.mtimeNsec, 4);
+        put_be(out, st.dev, 8);
+        put_be(out, st.ino, 8);
+        put_be(out, strtoul(entry->mode.c_str(), nullptr, 8), 4);
+        put_be(out, st.size, 8);
+        out.insert(out.end(), entry->oid.bytes, entry->oid.bytes + 20);
+        put_be(out, entry->path.size(), 2);
+        out.insert(out.end(), entry->path.begin(), entry->path.end());
+        do {
+            out.push_back(0);
+        } while ((out.size() - start) % 8 != 0);
+    }
+
+    size_t lenAt;
+    const CachedTree *cacheTree = extensions.cacheTree;
+    const IndexLink *link = extensions.link;
+    const IndexFsmonitor *fsmonitor = extensions.fsmonitor;
+    const UntrackedCache *untracked = extensions.untracked;
+    if (cacheTree && (cacheTree->valid() || !cacheTree->children.empty())) {
+        begin_extension(out, EXT_TREE, lenAt);
+        write_cached_tree(out, *cacheTree);
+        end_extension(out, lenAt);
+    }
+    if (link) {
+        begin_extension(out, EXT_LINK, lenAt);
+        out.insert(out.end(), link->base.bytes, link->base.bytes + 20);
+        put_be(out, link->removed.size(), 4);
+        for (const string &removed : link->removed) {
+            out.insert(out.end(), removed.begin(), removed.end());
+            out.push_back(0);
+        }
+        end_extension(out, lenAt);
+    }
+    if (fsmonitor && !fsmonitor->token.empty()) {
+        begin_extension(out, EXT_FSMONITOR, lenAt);
+        out.insert(out.end(), fsmonitor->token.begin(), fsmonitor->token.end());
+        out.push_back(0);
+        put_be(out, fsmonitor->dirty.size(), 4);
+        for (const string &dirty : fsmonitor->dirty) {
+            out.insert(out.end(), dirty.begin(), dirty.end());
+            out.push_back(0);
+        }
+        end_extension(out, lenAt);
+    }
+    if (untracked && untracked->present) {
+        begin_extension(out, EXT_UNTRACKED, lenAt);
+        out.insert(out.end(), untracked->rulesId.bytes, untracked->rulesId.bytes + 20);
+        out.insert(out.end(), untracked->token.begin(), untracked->token.end());
+        out.push_back(0);
+        write_untracked_dir(out, untracked->root);
+        end_extension(out, lenAt);
+    }
+
+    SHA1_CTX ctx;
+    sha1_init(ctx);
+    sha1_update(ctx, out.data(), out.size());
+    uint8_t sum[20];
+    sha1_final(ctx, sum);
+    out.insert(out.end(), sum, sum + 20);
+    return out;
+}
+
+// Write through a temp file and rename
+static void write_index_file(const string &path, const vector<uint8_t> &data) {
+    static const uint64_t seed = (uint64_t(random_device{}()) << 32) ^ random_device{}();
+    ostringstream tmpName;
+    tmpName << path << ".tmp_" << hex << seed;
+    string tmp = tmpName.str();
+    {
+        ofstream f(tmp, ios::binary | ios::trunc);
+        if (!f) throw runtime_error("Unable to write index file: " + tmp);
+        f.write(reinterpret_cast<const char*>(data.data()), data.size());
+        f.close();
+        if (!f) {
+            error_code ec;
+            fs::remove(tmp, ec);
+            throw runtime_error("Unable to write index file: " + tmp);
+        }
+    }
+    fs::rename(tmp, path);
+}
+
+void Index::save(const string &path) {
+    ObjectId oldBase = baseId_;
+    IndexExtensionsOut extensions;
+    extensions.cacheTree = &cacheTree_;
+    extensions.fsmonitor = &fsmonitor_;
+    extensions.untracked = &untrackedCache_;
+
+    if (!config_get_bool("index.splitIndex", false)) {
+        vector<const IndexEntry*> all;
+        all.reserve(entries_.size());
+        for (const IndexEntry &entry : entries_) all.push_back(&entry);
+        write_index_file(path, encode_index(all, extensions));
+        base_.clear();
+        baseId_ = ObjectId();
+    } else {
+        // Changes against the base, found by walking both sorted arrays
+        vector<const IndexEntry*> changed;
+        IndexLink link;
+        link.present = true;
+        size_t a = 0, b = 0;
+        while (a < base_.size() || b < entries_.size()) {
+            if (b == entries_.size() || (a < base_.size() && base_[a].path < entries_[b].path)) {
+                link.removed.push_back(base_[a++].path);
+            } else if (a == base_.size() || entries_[b].path < base_[a].path) {
+                changed.push_back(&entries_[b++]);
+            } else {
+                const IndexEntry &was = base_[a++];
+                const IndexEntry &now = entries_[b++];
+                if (was.oid != now.oid || was.mode != now.mode || !same_stat(was.stat, stored_stat(now)))
+                    changed.push_back(&now);
+            }
+        }
+
+        // Fold everything into a new base once the changes grow past the threshold
+        uint64_t threshold = uint64_t(max(0, config_get_int("index.splitThreshold", 20)));
+        if (baseId_.is_null() || (changed.size() + link.removed.size()) * 100 > threshold * base_.size()) {
+            vector<const IndexEntry*> all;
+            all.reserve(entries_.size());
+            for (const IndexEntry &entry : entries_) all.push_back(&entry);
+            vector<uint8_t> base = encode_index(all, IndexExtensionsOut());
+            memcpy(baseId_.bytes, base.data() + base.size() - 20, 20);
+            string basePath = shared_index_path(path, baseId_);
+            if (!fs::exists(basePath)) write_index_file(basePath, base);
+
+            base_ = entries_;
+            for (IndexEntry &entry : base_) entry.stat = stored_stat(entry);
+            changed.clear();
+            link.removed.clear();
+        }
+        link.base = baseId_;
+        extensions.link = &link;
+        write_index_file(path, encode_index(changed, extensions));
+    }
+
+    // Drop bases the index no longer refers to, including ones left behind
+    // by an index that was replaced without being loaded
+    if (baseId_ != oldBase || baseId_.is_null()) {
+        string keep = baseId_.is_null() ? "" : fs::path(shared_index_path(path, baseId_)).filename().string();
+        error_code ec;
+        fs::path dir = fs::path(path).parent_path();
+        for (const auto &file : fs::directory_iterator(dir.empty() ? "." : dir, ec)) {
+            string name = file.path().filename().string();
+            if (name.rfind("sharedindex.", 0) == 0 && name != keep) {
+                error_code removeEc;
+                fs::remove(file.path(), removeEc);
+            }
+        }
+    }
+}
+
+// ----------------- Stat data -----------------
+
+bool index_stat_file(const string &path, IndexStat &out) {
+#ifdef _WIN32
+    error_code ec;
+    uint64_t size = fs::file_size(path, ec);
+    if (ec) return false;
+    auto mtime = fs::last_write_time(path, ec);
+    if (ec) return false;
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(mtime.time_since_epoch()).count();
+    out = IndexStat();
+    out.mtimeSec = uint32_t(ns / 1000000000);
+    out.mtimeNsec = uint32_t(ns % 1000000000);
+    out.size = size;
+    return true;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+    out.ctimeSec = uint32_t(st.st_ctim.tv_sec);
+    out.ctimeNsec = uint32_t(st.st_ctim.tv_nsec);
+    out.mtimeSec = uint32_t(st.st_mtim.tv_sec);
+    out.mtimeNsec = uint32_t(st.st_mtim.tv_nsec);
+    out.dev = uint64_t(st.st_dev);
+    out.ino = uint64_t(st.st_ino);
+    out.size = uint64_t(st.st_size);
+    return true;
+#endif
+}
+
+bool Index::entry_is_clean(const IndexEntry &entry, const IndexStat &current) const {
+    const IndexStat &recorded = entry.stat;
+    if (recorded.empty()) return false;
+    if (recorded.mtimeSec != current.mtimeSec || recorded.mtimeNsec != current.mtimeNsec ||
+        recorded.ctimeSec != current.ctimeSec || recorded.ctimeNsec != current.ctimeNsec ||
+        recorded.size != current.size || recorded.ino != current.ino || recorded.dev != current.dev)
+        return false;
+    return true;
+}
+
+// Same clock as index_stat_file's mtimes
+static uint64_t now_ns() {
+#ifdef _WIN32
+    auto now = fs::file_time_type::clock::now().time_since_epoch();
+#else
+    auto now = chrono::system_clock::now().time_since_epoch();
+#endif
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count());
+}
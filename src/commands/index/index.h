@@ -0,0 +1,169 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../hash_object/object_id.h"
+
+// The staging index, .mintvcs/index. Version 2 is binary:
+//
+//   "MNDX" | version u32 | count u32 | entries... | extensions... | SHA-1 of the above
+//   entry: ctime s/ns u32 | mtime s/ns u32 | dev u64 | ino u64 | mode u32
+//          | size u64 | oid[20] | path length u16 | path | NUL padding to 8 bytes
+//   extension: signature[4] | length u32 | data
+//     "TREE": the cached tree, one record per directory in pre-order:
+//             name | NUL | entry count i32 | child count u32 | oid[20] if count >= 0
+//     "LINK": marks a split index: base checksum[20] | removed count u32
+//             | removed paths, each NUL-terminated
+//     "FSMN": fsmonitor state: token | NUL | dirty count u32 | dirty paths,
+//             each NUL-terminated
+//     "UNTR": the untracked cache: ignore rules id[20] | fsmonitor token | NUL,
+//             then one record per directory in pre-order: name | NUL | listed u8 | if listed:
+//             ctime s/ns u32 | mtime s/ns u32 | dev u64 | ino u64 |
+//             file count u32 | file names, each NUL-terminated | child count u32
+//
+// With index.splitIndex set, the entries live in a rarely rewritten base,
+// sharedindex.<checksum> next to the index, and the index itself holds only
+// the entries added or changed since plus the paths removed since. Once those
+// exceed index.splitThreshold percent (default 20) of the base, save() folds
+// them into a new base.
+//
+// All integers are big-endian. Unknown extensions are skipped. Version 1 (one "mode type oid path" text line
+// per entry) is still read; it carries no stat data, so every entry of a
+// version 1 index is treated as unverified until it is written again.
+
+// What stat() said about a file when its entry was recorded
+struct IndexStat {
+    uint32_t ctimeSec = 0;
+    uint32_t ctimeNsec = 0;
+    uint32_t mtimeSec = 0;
+    uint32_t mtimeNsec = 0;
+    uint64_t dev = 0;
+    uint64_t ino = 0;
+    uint64_t size = 0;
+
+    bool empty() const { return mtimeSec == 0 && mtimeNsec == 0 && size == 0 && ino == 0; }
+};
+
+struct IndexEntry {
+    std::string mode;   // "100644"
+    ObjectId oid;
+    std::string path;   // '/'-separated, relative to the repository root
+    IndexStat stat;
+};
+
+// The tree object last written for a directory, so commit can reuse subtrees
+// whose entries have not changed since
+struct CachedTree {
+    std::string name;         // "" for the root
+    int32_t entryCount = -1;  // index entries below this directory; -1 = invalid
+    ObjectId oid;
+    std::vector<CachedTree> children;
+
+    bool valid() const { return entryCount >= 0; }
+    // nullptr if there is no cached child directory of that name
+    CachedTree *child(std::string_view childName);
+    const CachedTree *child(std::string_view childName) const;
+};
+
+// Where the index stood against the fsmonitor daemon: the token of the last
+// full check, and the entries that did not match the working tree then.
+// Entries not dirty and not changed since the token still match.
+struct IndexFsmonitor {
+    std::string token;               // empty: no check recorded
+    std::vector<std::string> dirty;  // sorted
+
+    bool is_dirty(std::string_view path) const;
+};
+
+// The untracked files of one directory as last listed, and its subdirectories
+// that are not ignored. While the directory's stat data is unchanged no file
+// can have been created or removed in it, so the listing still holds.
+struct UntrackedDir {
+    std::string name;                    // "" for the root
+    bool listed = false;                 // files and stat are from a listing
+    IndexStat stat;                      // the directory's own
+    std::vector<std::string> files;      // names; untracked when listed
+    std::vector<UntrackedDir> children;  // in directory order
+};
+
+// Only valid for the ignore rules it was built with. token is the fsmonitor
+// token the listings were last checked against, which can lag behind the
+// index's own when a status skipped untracked files.
+struct UntrackedCache {
+    bool present = false;
+    ObjectId rulesId;
+    std::string token;  // empty: not checked through fsmonitor
+    UntrackedDir root;
+};
+
+static const char INDEX_PATH[] = ".mintvcs/index";
+
+// The index as one contiguous array of entries sorted by path. load() maps the
+// file and decodes it in a single pass; lookups are binary searches, and a save
+// writes the array out in order without any re-sorting.
+class Index {
+public:
+    // Read either index version; a missing file is an empty index. Throws on
+    // a corrupt binary index.
+    void load(const std::string &path = INDEX_PATH);
+    // Write a version 2 index through a temp file and rename; in split mode
+    // only the changes against the base are written
+    void save(const std::string &path = INDEX_PATH);
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    std::vector<IndexEntry>::iterator begin() { return entries_.begin(); }
+    std::vector<IndexEntry>::iterator end() { return entries_.end(); }
+    std::vector<IndexEntry>::const_iterator begin() const { return entries_.begin(); }
+    std::vector<IndexEntry>::const_iterator end() const { return entries_.end(); }
+    const std::vector<IndexEntry> &entries() const { return entries_; }
+
+    // nullptr if the path is not in the index
+    IndexEntry *find(std::string_view path);
+    const IndexEntry *find(std::string_view path) const;
+
+    // Insert or replace entries by path. The run is sorted first if needed; for
+    // several entries with one path the last one wins. Cached trees along the
+    // paths of new or changed entries are invalidated.
+    void merge(std::vector<IndexEntry> run);
+
+    CachedTree &cache_tree() { return cacheTree_; }
+    IndexFsmonitor &fsmonitor() { return fsmonitor_; }
+    const IndexFsmonitor &fsmonitor() const { return fsmonitor_; }
+    UntrackedCache &untracked_cache() { return untrackedCache_; }
+    // Invalidate the cached tree of every directory containing path
+    void invalidate_path(std::string_view path);
+
+    // True if the file's stat data still matches what the entry recorded,
+    // i.e. its content can be trusted without rehashing.
+    //
+    // A file changed within the same timestamp tick as its stat was taken
+    // would look unchanged. Such "racy" entries never keep their stat data:
+    // load() drops it for files modified no earlier than the index file, and
+    // save() for files modified since shortly before this process started.
+    bool entry_is_clean(const IndexEntry &entry, const IndexStat &current) const;
+
+private:
+    std::vector<IndexEntry> entries_;
+    CachedTree cacheTree_;
+    IndexFsmonitor fsmonitor_;
+    UntrackedCache untrackedCache_;
+    // Split index: the base's entries as stored, and its checksum (null when
+    // the index is not split)
+    std::vector<IndexEntry> base_;
+    ObjectId baseId_;
+};
+
+// True if entries [start, start + count) are exactly those under dir/ ("" is
+// the root), i.e. the range a valid cached tree for dir must cover
+bool index_range_is_dir(const std::vector<IndexEntry> &entries, size_t start, size_t count, std::string_view dir);
+
+// Stat a working-tree file; false if it cannot be stat'ed or is not a
+// regular file
+bool index_stat_file(const std::string &path, IndexStat &out);
+
+#endif
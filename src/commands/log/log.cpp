@@ -3,10 +3,12 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <filesystem>
 #include <vector>
 
 #include "../hash_object/hash_object.h"
+#include "../hash_object/object_store.h"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -18,24 +20,14 @@ static string trim(const string &s) {
     return s.substr(start, end - start + 1);
 }
 
-static string readObject(const string &oid) {
-    fs::path objPath = fs::path(".mintvcs/objects") / oid.substr(0, 2) / oid.substr(2);
-    if (!fs::exists(objPath)) throw runtime_error("Object not found: " + objPath.string());
-    vector<uint8_t> data = read_object_file(objPath.string());
-    vector<uint8_t> decompressed = zlib_decompress_bytes(data);
-    return string(decompressed.begin(), decompressed.end());
-}
-
-static void parseCommit(const string &content, string &parentHash, string &message) {
+static void parseCommit(string_view content, string &parentHash, string &message) {
     parentHash.clear();
     message.clear();
-    istringstream ss(content);
-    string line;
     bool messageStart = false;
-    while (getline(ss, line)) {
+    for_each_line(content, [&](string_view line) {
         if (!messageStart) {
             if (line.rfind("parent ", 0) == 0) {
-                parentHash = trim(line.substr(7));
+                parentHash = trim(string(line.substr(7)));
             }
             else if (line.empty()) {
                 messageStart = true;
@@ -44,7 +36,8 @@ static void parseCommit(const string &content, string &parentHash, string &messa
             if (!message.empty()) message += "\n";
             message += line;
         }
-    }
+        return true;
+    });
 }
 
 static string resolveHead() {
@@ -101,16 +94,16 @@ void mintvcs_log() {
         string commitHash = resolveHead();
         
         while (!commitHash.empty()) {
-            string content;
+            ObjectRef commit;
             try {
-                content = readObject(commitHash);
+                commit = object_store_get(commitHash);
             } catch (const exception &ex) {
                 cerr << "Error reading commit " << commitHash << ": " << ex.what() << "\n";
                 return;
             }
 
             string parentHash, message;
-            parseCommit(content, parentHash, message);
+            parseCommit(commit->body(), parentHash, message);
 
             cout << "commit " << commitHash << "\n";
             if (!parentHash.empty()) {
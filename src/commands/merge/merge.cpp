@@ -1,7 +1,10 @@
 #include <bits/stdc++.h>
 #include <filesystem>
 #include "../hash_object/hash_object.h"
+#include "../hash_object/object_store.h"
+#include "../hash_object/tree_format.h"
 #include "../commit/commit.h"
+#include "../config/config.h"
 #include "../branch/branch.h"
 
 using namespace std;
@@ -9,152 +12,114 @@ namespace fs = std::filesystem;
 
 static const fs::path repoPath = ".mintvcs";
 
-// Build path for object file from 40-char hex sha
-static fs::path objectPathFromHex(const string &hex40) {
-    if (hex40.size() < 2) throw runtime_error("objectPathFromHex: invalid hex length");
-    return repoPath / "objects" / hex40.substr(0,2) / hex40.substr(2);
-}
-
-// Read compressed object file and return decompressed string (header + body)
-static string readObjectDecompressed(const string &hex40) {
-    fs::path p = objectPathFromHex(hex40);
-    if (!fs::exists(p)) throw runtime_error("Object not found: " + p.string());
-    vector<uint8_t> comp = read_file_bytes(p.string()); // from hash_object.h
-    vector<uint8_t> raw = zlib_decompress_bytes(comp);
-    string decomp(raw.begin(), raw.end());
-    return decomp;
-}
-
 // Create and write a blob object from raw contents (no header).
-// Returns blob hex (40 chars).
-static string writeBlobObjectFromString(const string &data) {
+// Returns the blob id.
+static ObjectId writeBlobObjectFromString(const string &data) {
     string header = "blob " + to_string(data.size()) + '\0';
     string full = header + data;
     // compute oid
     vector<uint8_t> full_bytes(full.begin(), full.end());
-    string oid = sha1_hex_of_bytes(full_bytes); // from hash_object.h
+    ObjectId oid = sha1_of_bytes(full_bytes.data(), full_bytes.size()); // from hash_object.h
     // compress and write
     vector<uint8_t> compressed = zlib_compress_bytes(full_bytes);
-    write_object_file(oid, compressed);
+    write_object_file(oid.hex(), compressed);
     return oid;
 }
 
 // ----------------- Parse functions -----------------
 
 // Parse decompressed commit object (return tree hash and parents)
-static pair<string, vector<string>> parseCommitObject(const string &decompressed) {
+static pair<string, vector<string>> parseCommitObject(string_view decompressed) {
     // Decompressed looks like: "commit <size>\0" + body lines (e.g. "tree <hash>\nparent <hash>\n...\n\nmsg")
     size_t nul = decompressed.find('\0');
-    if (nul == string::npos) throw runtime_error("parseCommitObject: malformed commit (no NUL)");
-    string body = decompressed.substr(nul + 1);
-    istringstream iss(body);
-    string line;
+    if (nul == string_view::npos) throw runtime_error("parseCommitObject: malformed commit (no NUL)");
+    string_view body = decompressed.substr(nul + 1);
     string treeHash;
     vector<string> parents;
-    while (getline(iss, line)) {
+    for_each_line(body, [&](string_view line) {
         if (line.rfind("tree ", 0) == 0) {
-            string t = line.substr(5);
-            if (t.size() == 40) treeHash = t;
+            string_view t = line.substr(5);
+            if (t.size() == 40) treeHash = string(t);
         } else if (line.rfind("parent ", 0) == 0) {
-            string p = line.substr(7);
-            if (p.size() == 40) parents.push_back(p);
+            string_view p = line.substr(7);
+            if (p.size() == 40) parents.emplace_back(p);
         } else if (line.empty()) {
-            break; // end of headers
+            return false; // end of headers
         }
-    }
+        return true;
+    });
     if (treeHash.empty()) throw runtime_error("parseCommitObject: tree hash not found");
     return {treeHash, parents};
 }
 
 // Parse decompressed tree object produced by your computeTreeHash
-// Format assumed:
-// "tree <size>\0" + repeated entries:
-//   "<mode> <name>\0<40-hex>" (40 ASCII hex chars) -- note: this matches your computeTreeHash
-static TreeNode* parseTreeObjectFromDecompressed(const string &decompressed, const string &treeHex) {
-    const char *ptr = decompressed.data();
-    const char *end = ptr + decompressed.size();
+// Format: "tree <size>\0" + a tree body in either version (see tree_format.h)
+// The entries become children of dir, allocated in arena
+static void parseTreeObjectFromDecompressed(string_view decompressed, TreeNode *dir, TreeArena &arena) {
     const string prefix = "tree ";
-    if ((size_t)(end - ptr) < prefix.size() || strncmp(ptr, prefix.c_str(), prefix.size()) != 0)
+    if (decompressed.compare(0, prefix.size(), prefix) != 0)
         throw runtime_error("parseTreeObject: invalid header");
 
     // skip "tree " and decimal size upto NUL
-    ptr += prefix.size();
-    while (ptr < end && *ptr != '\0') ++ptr;
-    if (ptr >= end) throw runtime_error("parseTreeObject: malformed header (no NUL)");
-    ++ptr; // skip NUL
-
-    TreeNode *dir = new TreeNode(treeHex, "", true);
-    dir->children.clear();
-
-    while (ptr < end) {
-        // mode (until space)
-        string mode;
-        while (ptr < end && *ptr != ' ') mode.push_back(*ptr++);
-        if (ptr >= end || *ptr != ' ') throw runtime_error("parseTreeObject: malformed entry (mode)");
-        ++ptr; // skip space
-
-        bool isDir = (mode == "40000");
-
-        // name (until NUL)
-        string name;
-        while (ptr < end && *ptr != '\0') name.push_back(*ptr++);
-        if (ptr >= end) throw runtime_error("parseTreeObject: malformed entry (name)");
-        ++ptr; // skip NUL
-
-        // next 40 chars are hex sha
-        if ((size_t)(end - ptr) < 40) throw runtime_error("parseTreeObject: truncated sha in tree entry");
-        string sha = string(ptr, ptr + 40);
-        ptr += 40;
-
-        TreeNode *child = new TreeNode(sha, name, isDir);
-        dir->children.push_back(child);
-    }
+    size_t nul = decompressed.find('\0');
+    if (nul == string_view::npos) throw runtime_error("parseTreeObject: malformed header (no NUL)");
 
-    return dir;
+    tree_for_each_entry(decompressed.substr(nul + 1), [&](const TreeEntryView &entry) {
+        dir->append(arena.node(entry.oid, entry.name, entry.isDir()));
+    });
 }
 
-// Recursively load tree (given tree hex) into TreeNode structure, using parseTreeObjectFromDecompressed
-static TreeNode* loadTreeRecursive(const string &treeHex) {
-    string decompressed = readObjectDecompressed(treeHex);
-    TreeNode *node = parseTreeObjectFromDecompressed(decompressed, treeHex);
+// Fill dir, whose sha1 is set, and every directory below it
+static void loadTreeInto(TreeNode *dir, TreeArena &arena) {
+    {
+        // let go of the object before its subtrees are read
+        ObjectRef tree = object_store_get(dir->sha1);
+        parseTreeObjectFromDecompressed(tree->raw(), dir, arena);
+    }
     // recursively load subtrees (directories)
-    for (auto child : node->children) {
-        if (child->isDir) {
-            TreeNode *sub = loadTreeRecursive(child->sha1);
-            // transfer subtree children (avoid double-free by clearing subtree object children container after move)
-            child->children = sub->children;
-            sub->children.clear();
-            delete sub;
-        }
+    for (auto child : dir->children()) {
+        if (child->isDir) loadTreeInto(child, arena);
     }
-    return node;
 }
 
-// read blob content (decompressed body only)
+// Recursively load tree (given tree hex) into TreeNode structure, using parseTreeObjectFromDecompressed
+static TreeNode* loadTreeRecursive(const ObjectId &treeId, TreeArena &arena) {
+    TreeNode *root = arena.node(treeId, "", true);
+    loadTreeInto(root, arena);
+    return root;
+}
+
+// read blob content (decompressed body only), appended as it is inflated
 static string readBlobContent(const string &blobHex) {
-    string decomp = readObjectDecompressed(blobHex);
-    size_t nul = decomp.find('\0');
-    if (nul == string::npos) throw runtime_error("readBlobContent: malformed blob");
-    return decomp.substr(nul + 1);
+    string body;
+    stream_object(blobHex,
+        [&](const string &type, uint64_t size) {
+            if (type != "blob") throw runtime_error("readBlobContent: not a blob: " + blobHex);
+            body.reserve(static_cast<size_t>(size));
+            return true;
+        },
+        [&](const uint8_t *data, size_t len) {
+            body.append(reinterpret_cast<const char*>(data), len);
+        });
+    return body;
 }
 
 // ----------------- Graph helpers: parents and LCA -----------------
 
 // get parents of commit (hex strings)
 static vector<string> get_parents_of_commit(const string &commitHex) {
-    string decompressed = readObjectDecompressed(commitHex);
-    size_t nul = decompressed.find('\0');
-    if (nul == string::npos) return {};
-    string body = decompressed.substr(nul + 1);
+    ObjectRef commit = object_store_get(commitHex);
+    string_view body = commit->body();
     vector<string> parents;
-    istringstream iss(body);
-    string line;
-    while (getline(iss, line)) {
+    for_each_line(body, [&](string_view line) {
         if (line.rfind("parent ", 0) == 0) {
-            string p = line.substr(7);
-            if (p.size() == 40) parents.push_back(p);
-        } else if (line.empty()) break;
-    }
+            string_view p = line.substr(7);
+            if (p.size() == 40) parents.emplace_back(p);
+        } else if (line.empty()) {
+            return false;
+        }
+        return true;
+    });
     return parents;
 }
 
@@ -203,25 +168,25 @@ static string findLCA(const string &a, const string &b) {
 
 // ----------------- Tree flattening & merge -----------------
 
-// collect files into map<path, shaHex>
-static void collectFiles(TreeNode *node, const string &prefix, unordered_map<string,string> &out) {
+// collect files into map<path, sha>
+static void collectFiles(TreeNode *node, const string &prefix, unordered_map<string,ObjectId> &out) {
     if (!node) return;
-    for (auto child : node->children) {
-        string path = prefix.empty() ? child->name : prefix + "/" + child->name;
+    for (auto child : node->children()) {
+        string path = prefix.empty() ? string(child->name) : prefix + "/" + string(child->name);
         if (child->isDir) collectFiles(child, path, out);
         else out[path] = child->sha1;
     }
 }
 
 struct MergeResult {
-    unordered_map<string,string> merged; // path -> sha
+    unordered_map<string,ObjectId> merged; // path -> sha
     unordered_set<string> conflicts;
 };
 
 // 3-way simple merge decision (flag conflict when both changed and differ)
-static MergeResult mergeFileMaps(const unordered_map<string,string> &base,
-                                 const unordered_map<string,string> &src,
-                                 const unordered_map<string,string> &tgt) {
+static MergeResult mergeFileMaps(const unordered_map<string,ObjectId> &base,
+                                 const unordered_map<string,ObjectId> &src,
+                                 const unordered_map<string,ObjectId> &tgt) {
     MergeResult res;
     unordered_set<string> all;
     for (auto &p : base) all.insert(p.first);
@@ -229,29 +194,30 @@ static MergeResult mergeFileMaps(const unordered_map<string,string> &base,
     for (auto &p : tgt)  all.insert(p.first);
 
     for (auto &path : all) {
-        string b = base.count(path) ? base.at(path) : string();
-        string s = src.count(path)  ? src.at(path)  : string();
-        string t = tgt.count(path)  ? tgt.at(path)  : string();
+        // a null id means the path is absent on that side
+        ObjectId b = base.count(path) ? base.at(path) : ObjectId();
+        ObjectId s = src.count(path)  ? src.at(path)  : ObjectId();
+        ObjectId t = tgt.count(path)  ? tgt.at(path)  : ObjectId();
 
         // both removed
-        if (s.empty() && t.empty()) continue;
+        if (s.is_null() && t.is_null()) continue;
 
-        if (!s.empty() && !t.empty() && s == t) {
+        if (!s.is_null() && !t.is_null() && s == t) {
             res.merged[path] = s;
         }
-        else if (s == b && !t.empty()) {
+        else if (s == b && !t.is_null()) {
             // only target changed
             res.merged[path] = t;
         }
-        else if (t == b && !s.empty()) {
+        else if (t == b && !s.is_null()) {
             // only source changed
             res.merged[path] = s;
         }
-        else if (b.empty() && !s.empty() && t.empty()) {
+        else if (b.is_null() && !s.is_null() && t.is_null()) {
             // added in src
             res.merged[path] = s;
         }
-        else if (b.empty() && !t.empty() && s.empty()) {
+        else if (b.is_null() && !t.is_null() && s.is_null()) {
             // added in tgt
             res.merged[path] = t;
         }
@@ -265,11 +231,11 @@ static MergeResult mergeFileMaps(const unordered_map<string,string> &base,
 }
 
 // build a TreeNode tree from map<path, sha>
-static TreeNode* buildMergedTree(const unordered_map<string,string> &mergedMap) {
-    TreeNode *root = new TreeNode("", "", true);
+static TreeNode* buildMergedTree(const unordered_map<string,ObjectId> &mergedMap, TreeArena &arena) {
+    TreeNode *root = arena.node(ObjectId(), "", true);
     for (auto &kv : mergedMap) {
         const string &path = kv.first;
-        const string &sha  = kv.second;
+        const ObjectId &sha = kv.second;
         vector<string> parts;
         string tmp;
         stringstream ss(path);
@@ -279,11 +245,10 @@ static TreeNode* buildMergedTree(const unordered_map<string,string> &mergedMap)
         for (size_t i = 0; i < parts.size(); ++i) {
             bool isLeaf = (i + 1 == parts.size());
             // find child
-            TreeNode *next = nullptr;
-            for (auto c : cur->children) if (c->name == parts[i]) { next = c; break; }
+            TreeNode *next = cur->child(parts[i]);
             if (!next) {
-                next = new TreeNode("", parts[i], !isLeaf);
-                cur->children.push_back(next);
+                next = arena.node(ObjectId(), parts[i], !isLeaf);
+                cur->append(next);
             }
             cur = next;
             if (isLeaf) cur->sha1 = sha;
@@ -294,10 +259,10 @@ static TreeNode* buildMergedTree(const unordered_map<string,string> &mergedMap)
 
 // ----------------- Merge high-level -----------------
 
-// Create conflict blob for a path given src/tgt blob hex. Returns new blob hex.
-static string createConflictBlob(const string &srcHex, const string &tgtHex, const string &path) {
-    string srcContent = srcHex.empty() ? string() : readBlobContent(srcHex);
-    string tgtContent = tgtHex.empty() ? string() : readBlobContent(tgtHex);
+// Create conflict blob for a path given src/tgt blob ids. Returns the new blob id.
+static ObjectId createConflictBlob(const ObjectId &srcId, const ObjectId &tgtId, const string &path) {
+    string srcContent = srcId.is_null() ? string() : readBlobContent(srcId.hex());
+    string tgtContent = tgtId.is_null() ? string() : readBlobContent(tgtId.hex());
 
     string mergedText;
     mergedText += "<<<<<<< SOURCE\n";
@@ -309,31 +274,20 @@ static string createConflictBlob(const string &srcHex, const string &tgtHex, con
     mergedText += ">>>>>>> TARGET\n";
 
     // create blob object
-    string blobHex = writeBlobObjectFromString(mergedText);
-    return blobHex;
+    return writeBlobObjectFromString(mergedText);
 }
 
 // Merge three tree hexes (base, source, target). Returns merged tree hex and sets conflicts list
 static pair<string, vector<string>> mergeTrees(const string &baseTreeHex,
                                               const string &srcTreeHex,
                                               const string &tgtTreeHex) {
-    // load recursive trees
-    TreeNode *baseRoot = nullptr;
-    TreeNode *srcRoot  = nullptr;
-    TreeNode *tgtRoot  = nullptr;
-    try {
-        baseRoot = loadTreeRecursive(baseTreeHex);
-        srcRoot  = loadTreeRecursive(srcTreeHex);
-        tgtRoot  = loadTreeRecursive(tgtTreeHex);
-    } catch (const exception &e) {
-        // cleanup partial allocations
-        if (baseRoot) { /* free tree */ }
-        if (srcRoot)  { /* free tree */ }
-        if (tgtRoot)  { /* free tree */ }
-        throw;
-    }
+    // load recursive trees; the arena frees all of them however we leave
+    TreeArena arena;
+    TreeNode *baseRoot = loadTreeRecursive(ObjectId::from_hex(baseTreeHex), arena);
+    TreeNode *srcRoot  = loadTreeRecursive(ObjectId::from_hex(srcTreeHex), arena);
+    TreeNode *tgtRoot  = loadTreeRecursive(ObjectId::from_hex(tgtTreeHex), arena);
 
-    unordered_map<string,string> baseFiles, srcFiles, tgtFiles;
+    unordered_map<string,ObjectId> baseFiles, srcFiles, tgtFiles;
     collectFiles(baseRoot, "", baseFiles);
     collectFiles(srcRoot,  "", srcFiles);
     collectFiles(tgtRoot,  "", tgtFiles);
@@ -341,30 +295,19 @@ static pair<string, vector<string>> mergeTrees(const string &baseTreeHex,
     MergeResult mr = mergeFileMaps(baseFiles, srcFiles, tgtFiles);
 
     // produce final map: for conflicts, produce conflict blob and set sha accordingly
-    unordered_map<string,string> finalMap = mr.merged;
+    unordered_map<string,ObjectId> finalMap = mr.merged;
     vector<string> conflictPaths;
     for (const auto &p : mr.conflicts) {
-        string srcHex = srcFiles.count(p) ? srcFiles[p] : string();
-        string tgtHex = tgtFiles.count(p) ? tgtFiles[p] : string();
-        string conflictBlobHex = createConflictBlob(srcHex, tgtHex, p);
-        finalMap[p] = conflictBlobHex;
+        ObjectId srcId = srcFiles.count(p) ? srcFiles[p] : ObjectId();
+        ObjectId tgtId = tgtFiles.count(p) ? tgtFiles[p] : ObjectId();
+        finalMap[p] = createConflictBlob(srcId, tgtId, p);
         conflictPaths.push_back(p);
     }
 
     // build merged tree and compute tree hash using your computeTreeHash
-    TreeNode *mergedRoot = buildMergedTree(finalMap);
-    string mergedTreeHex = computeTreeHash(mergedRoot);
-
-    // cleanup trees (free memory)
-    std::function<void(TreeNode*)> freeTree = [&](TreeNode *n){
-        if (!n) return;
-        for (auto c : n->children) freeTree(c);
-        delete n;
-    };
-    freeTree(baseRoot);
-    freeTree(srcRoot);
-    freeTree(tgtRoot);
-    freeTree(mergedRoot);
+    TreeNode *mergedRoot = buildMergedTree(finalMap, arena);
+    WorkPool pool(resolve_job_count(0));
+    string mergedTreeHex = computeTreeHash(mergedRoot, pool).hex();
 
     return {mergedTreeHex, conflictPaths};
 }
@@ -431,14 +374,9 @@ int merge_branch(const string &targetBranch) {
     // get tree hashes from commits
     string baseTreeHex, headTreeHex, targetTreeHex;
     try {
-        string baseDecomp = readObjectDecompressed(lca);
-        baseTreeHex = parseCommitObject(baseDecomp).first;
-
-        string headDecomp = readObjectDecompressed(headCommit);
-        headTreeHex = parseCommitObject(headDecomp).first;
-
-        string tgtDecomp = readObjectDecompressed(targetCommit);
-        targetTreeHex = parseCommitObject(tgtDecomp).first;
+        baseTreeHex = parseCommitObject(object_store_get(lca)->raw()).first;
+        headTreeHex = parseCommitObject(object_store_get(headCommit)->raw()).first;
+        targetTreeHex = parseCommitObject(object_store_get(targetCommit)->raw()).first;
     } catch (const exception &e) {
         cerr << "merge: failed to read commit objects: " << e.what() << "\n";
         return 1;
@@ -0,0 +1,250 @@
+#include "repack.h"
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "../hash_object/delta.h"
+#include "../hash_object/hash_object.h"
+#include "../hash_object/mapped_file.h"
+#include "../hash_object/pack.h"
+#include "../hash_object/tree_format.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const fs::path OBJECTS_PATH = ".mintvcs/objects";
+
+static bool isHex(const string &s) {
+    for (char c : s) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) return false;
+    }
+    return !s.empty();
+}
+
+// Loose objects live in .mintvcs/objects/xx/<38 hex chars>
+static vector<string> collectLooseObjects() {
+    vector<string> oids;
+    for (const auto &dir : fs::directory_iterator(OBJECTS_PATH)) {
+        string prefix = dir.path().filename().string();
+        if (!dir.is_directory() || prefix.size() != 2 || !isHex(prefix)) continue;
+        for (const auto &file : fs::directory_iterator(dir.path())) {
+            string rest = file.path().filename().string();
+            if (file.is_regular_file() && rest.size() == 38 && isHex(rest)) {
+                oids.push_back(prefix + rest);
+            }
+        }
+    }
+    return oids;
+}
+
+// Delta search: each object is tried against the previous DELTA_WINDOW objects
+// of the same type in (type, name hash, size) order. Larger objects stay full.
+static const size_t DELTA_WINDOW = 10;
+static const uint64_t DELTA_MAX_OBJECT_SIZE = 16 * 1024 * 1024;
+static const uint64_t DELTA_MIN_OBJECT_SIZE = 64;
+
+struct DeltaCandidate {
+    string oid;
+    string type;
+    uint64_t size = 0;
+    uint32_t nameHash = 0;
+};
+
+// Hash of the file name that weighs the last characters most, so that
+// versions of one file (and files sharing an extension) sort next to each other
+static uint32_t nameHash(string_view name) {
+    uint32_t hash = 0;
+    for (unsigned char c : name) {
+        if (isspace(c)) continue;
+        hash = (hash >> 2) + (uint32_t(c) << 24);
+    }
+    return hash;
+}
+
+// Name hash for every object a tree refers to
+static void collectNameHints(string_view treeBody, unordered_map<string, uint32_t> &hints) {
+    tree_for_each_entry(treeBody, [&](const TreeEntryView &entry) {
+        hints.emplace(entry.oid.hex(), nameHash(entry.name));
+    });
+}
+
+// Choose a delta base for each object where one saves space. Returns the
+// encoded pack payloads keyed by oid.
+static unordered_map<string, vector<uint8_t>> findDeltas(const vector<string> &oids) {
+    vector<DeltaCandidate> candidates;
+    unordered_map<string, uint32_t> hints;
+    for (const string &oid : oids) {
+        DeltaCandidate c;
+        c.oid = oid;
+        stream_object(oid, [&](const string &type, uint64_t size) {
+            c.type = type;
+            c.size = size;
+            return false;
+        }, [](const uint8_t *, size_t) {});
+        if (c.type == "tree") collectNameHints(read_object(oid).body(), hints);
+        candidates.push_back(std::move(c));
+    }
+    for (DeltaCandidate &c : candidates) {
+        auto it = hints.find(c.oid);
+        if (it != hints.end()) c.nameHash = it->second;
+    }
+
+    sort(candidates.begin(), candidates.end(), [](const DeltaCandidate &a, const DeltaCandidate &b) {
+        if (a.type != b.type) return a.type < b.type;
+        if (a.nameHash != b.nameHash) return a.nameHash < b.nameHash;
+        if (a.size != b.size) return a.size > b.size;
+        return a.oid < b.oid;
+    });
+
+    struct WindowEntry {
+        const DeltaCandidate *candidate;
+        ObjectHandle object;
+        int depth;
+    };
+    deque<WindowEntry> window;
+    unordered_map<string, vector<uint8_t>> deltas;
+
+    for (const DeltaCandidate &c : candidates) {
+        if (c.size < DELTA_MIN_OBJECT_SIZE || c.size > DELTA_MAX_OBJECT_SIZE) continue;
+        ObjectHandle object = read_object(c.oid);
+        string_view raw = object.raw();
+        const uint8_t *target = reinterpret_cast<const uint8_t*>(raw.data());
+
+        const WindowEntry *best = nullptr;
+        vector<uint8_t> bestDelta;
+        for (const WindowEntry &entry : window) {
+            if (entry.candidate->type != c.type || entry.depth >= PACK_MAX_DELTA_DEPTH) continue;
+            size_t limit = bestDelta.empty() ? raw.size() / 2 : bestDelta.size() - 1;
+            string_view base = entry.object.raw();
+            vector<uint8_t> delta = delta_create(reinterpret_cast<const uint8_t*>(base.data()), base.size(),
+                                                 target, raw.size(), limit);
+            if (!delta.empty()) {
+                best = &entry;
+                bestDelta = std::move(delta);
+            }
+        }
+
+        int depth = 0;
+        if (best) {
+            vector<uint8_t> payload = pack_encode_delta(best->candidate->oid, bestDelta);
+            // Keep the delta only if it beats storing the object compressed
+            if (payload.size() < zlib_compress_bytes(vector<uint8_t>(target, target + raw.size())).size()) {
+                depth = best->depth + 1;
+                deltas.emplace(c.oid, std::move(payload));
+            }
+        }
+
+        window.push_back(WindowEntry{ &c, std::move(object), depth });
+        if (window.size() > DELTA_WINDOW) window.pop_front();
+    }
+    return deltas;
+}
+
+int mintvcs_repack(bool all) {
+    if (!fs::exists(".mintvcs")) {
+        cerr << "Not a mintvcs repository\n";
+        return 1;
+    }
+
+    try {
+        vector<string> loose = collectLooseObjects();
+        vector<string> existingPacks = pack_list_basenames();
+        vector<string> oldPacks = all ? existingPacks : vector<string>();
+
+        vector<string> oids = loose;
+        if (all) {
+            pack_for_each_object([&](const string &oid, const PackedEntry &) {
+                oids.push_back(oid);
+            });
+        }
+
+        if (oids.empty() || (!all && loose.empty()) || (all && loose.empty() && oldPacks.size() <= 1)) {
+            cout << "Nothing to repack\n";
+            return 0;
+        }
+
+        sort(oids.begin(), oids.end());
+        oids.erase(unique(oids.begin(), oids.end()), oids.end());
+        unordered_map<string, vector<uint8_t>> deltas = findDeltas(oids);
+
+        string base = pack_write(oids, [&](const string &oid, uint8_t &kind, vector<uint8_t> &payload) {
+            auto delta = deltas.find(oid);
+            if (delta != deltas.end()) {
+                kind = PACK_ENTRY_DELTA;
+                payload = std::move(delta->second);
+                return;
+            }
+            PackedEntry packed;
+            if (pack_find_object(oid, packed)) {
+                kind = PACK_ENTRY_FULL;
+                if (packed.kind == PACK_ENTRY_FULL) {
+                    payload.assign(packed.data, packed.data + packed.size);
+                } else {
+                    // an old delta whose base may now be a delta itself; store it whole
+                    ObjectHandle obj = read_object(oid);
+                    string_view raw = obj.raw();
+                    payload = zlib_compress_bytes(vector<uint8_t>(raw.begin(), raw.end()));
+                }
+                return;
+            }
+            MappedFile file;
+            if (!file.open(object_path(oid))) throw runtime_error("Object not found: " + oid);
+            kind = PACK_ENTRY_FULL;
+            payload.assign(file.data(), file.data() + file.size());
+        });
+
+        // Only delete anything once the new pack answers for every object and
+        // each of its entries rebuilds the object it claims to be
+        pack_reload();
+        try {
+            pack_verify(base);
+        } catch (...) {
+            // a bad pack must not shadow the good copies it was built from
+            if (find(existingPacks.begin(), existingPacks.end(), base) == existingPacks.end()) {
+                error_code ec;
+                fs::remove(base + ".idx", ec);
+                fs::remove(base + ".pack", ec);
+            }
+            pack_reload();
+            throw;
+        }
+        for (const string &oid : oids) {
+            if (!pack_has_object(oid)) throw runtime_error("new pack is missing object " + oid);
+        }
+
+        size_t removed = 0;
+        for (const string &oid : loose) {
+            error_code ec;
+            if (fs::remove(object_path(oid), ec)) ++removed;
+        }
+        for (const auto &dir : fs::directory_iterator(OBJECTS_PATH)) {
+            string prefix = dir.path().filename().string();
+            error_code ec;
+            if (dir.is_directory() && prefix.size() == 2 && isHex(prefix) && fs::is_empty(dir.path(), ec)) {
+                fs::remove(dir.path(), ec);
+            }
+        }
+
+        for (const string &old : oldPacks) {
+            if (old == base) continue;
+            error_code ec;
+            fs::remove(old + ".idx", ec);
+            fs::remove(old + ".pack", ec);
+        }
+        pack_reload();
+
+        cout << "Packed " << oids.size() << " objects (" << deltas.size() << " deltas) into "
+             << fs::path(base + ".pack").filename().string() << "\n";
+        cout << "Removed " << removed << " loose objects";
+        if (all && !oldPacks.empty()) cout << " and " << oldPacks.size() << " old pack(s)";
+        cout << "\n";
+        return 0;
+    } catch (const exception &ex) {
+        cerr << "repack failed: " << ex.what() << "\n";
+        return 1;
+    }
+}
@@ -0,0 +1,8 @@
+#ifndef REPACK_H
+#define REPACK_H
+
+// Move loose objects into a new pack. With all=true, existing packs are
+// folded into the new pack as well and removed afterwards.
+int mintvcs_repack(bool all);
+
+#endif
@@ -3,13 +3,24 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <filesystem>
-#include <unordered_set>
-#include <unordered_map>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
 
 #include "../hash_object/hash_object.h"
+#include "../hash_object/object_store.h"
+#include "../hash_object/tree_format.h"
+#include "../hash_object/work_pool.h"
+#include "../config/config.h"
+#include "../fsmonitor/fsmonitor.h"
+#include "../ignore/ignore.h"
+#include "../index/index.h"
+#include "untracked_cache.h"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -93,294 +104,289 @@ static string resolveHeadToCommit() {
     return line;
 }
 
-static string readObject(const string &oid) {
-    fs::path objPath = fs::path(".mintvcs/objects") / oid.substr(0, 2) / oid.substr(2);
-    if (!fs::exists(objPath)) {
-        throw runtime_error("Object not found: " + oid);
-    }
-    vector<uint8_t> data = read_object_file(objPath.string());
-    vector<uint8_t> decompressed = zlib_decompress_bytes(data);
-    return string(decompressed.begin(), decompressed.end());
-}
-
-static void parseObject(const string &raw, string &type, string &content) {
-    size_t nullPos = raw.find('\0');
-    if (nullPos == string::npos) {
-        throw runtime_error("Invalid object format");
-    }
-    
-    string header = raw.substr(0, nullPos);
-    content = raw.substr(nullPos + 1);
-    
-    size_t spacePos = header.find(' ');
-    if (spacePos == string::npos) {
-        throw runtime_error("Invalid object header");
-    }
-    
-    type = header.substr(0, spacePos);
-}
-
 static string getTreeFromCommit(const string &commitOid) {
-    string raw = readObject(commitOid);
-    string type, content;
-    parseObject(raw, type, content);
-    
-    if (type != "commit") {
-        throw runtime_error("Object is not a commit");
-    }
-    
-    istringstream ss(content);
-    string line;
-    while (getline(ss, line)) {
-        if (line.rfind("tree ", 0) == 0) {
-            return trim(line.substr(5));
-        }
-    }
+    ObjectRef commit = object_store_get(commitOid, "commit");
+    string_view content = commit->body();
+
+    string tree;
+    for_each_line(content, [&](string_view line) {
+        if (line.rfind("tree ", 0) != 0) return true;
+        tree = trim(string(line.substr(5)));
+        return false;
+    });
+    if (!tree.empty()) return tree;
     
     throw runtime_error("No tree found in commit");
 }
 
+// Local to this file; other commands have their own TreeEntry
+namespace {
 struct TreeEntry {
-    string mode;
     string name;
-    string oid;
+    string mode;
+    ObjectId oid;
     bool isDir;
 };
 
-static vector<TreeEntry> parseTree(const string &treeOid) {
-    string raw = readObject(treeOid);
-    string type, content;
-    parseObject(raw, type, content);
-    
-    if (type != "tree") {
-        throw runtime_error("Object is not a tree");
-    }
-    
-    vector<TreeEntry> entries;
-    size_t pos = 0;
-    
-    while (pos < content.size()) {
-        size_t spacePos = content.find(' ', pos);
-        if (spacePos == string::npos) break;
-        string mode = content.substr(pos, spacePos - pos);
-        pos = spacePos + 1;
-        
-        size_t nullPos = content.find('\0', pos);
-        if (nullPos == string::npos) break;
-        string name = content.substr(pos, nullPos - pos);
-        pos = nullPos + 1;
-        
-        if (pos + 40 > content.size()) break;
-        string oid = content.substr(pos, 40);
-        pos += 40;
-        
-        TreeEntry entry;
-        entry.mode = mode;
-        entry.name = name;
-        entry.oid = oid;
-        entry.isDir = (mode == "40000");
-        
-        entries.push_back(entry);
-    }
-    
-    return entries;
-}
+// HEAD's files in index order, read one tree object at a time. Only the
+// listings of the directories along the current path are held, so memory
+// follows the tree's depth rather than its size.
+//
+// A directory whose tree OID equals the index's cached tree for it holds
+// exactly the index's entries there. Such a directory is yielded as a whole,
+// without reading its tree, unless the caller descends into it.
+class HeadFiles {
+public:
+    // A null root is an empty tree
+    HeadFiles(const ObjectId &root, const CachedTree *cache);
 
-static void collectCommitFiles(const string &treeOid, 
-                               unordered_map<string, string> &files,
-                               const string &prefix = "") {
-    auto entries = parseTree(treeOid);
-    
-    for (const auto &entry : entries) {
-        string path = prefix.empty() ? entry.name : prefix + "/" + entry.name;
-        
-        if (entry.isDir) {
-            collectCommitFiles(entry.oid, files, path);
-        } else {
-            files[path] = entry.oid;
-        }
-    }
-}
+    bool done() const { return levels_.empty() && subtreeEntries_ == 0; }
+    // The current file, or the current subtree's directory ("" for the root)
+    const string &path() const { return path_; }
+    const string &mode() const { return mode_; }
+    const ObjectId &oid() const { return oid_; }
+    bool atSubtree() const { return subtreeEntries_ > 0; }
+    // Index entries the current subtree's cached tree covers
+    size_t subtreeEntries() const { return subtreeEntries_; }
 
-struct IndexEntry {
-    string mode;
-    string type;
-    string oid;
-    string path;
+    // Past the current file or the whole current subtree
+    void next();
+    // Into the current subtree after all
+    void descend();
+
+private:
+    struct Level {
+        string prefix;  // "" or ending in '/'
+        const CachedTree *cache;
+        vector<TreeEntry> entries;
+        size_t next = 0;
+    };
+
+    void push(const ObjectId &treeOid, string prefix, const CachedTree *cache);
+    // Descend until the next file or matching subtree, or run out
+    void settle();
+
+    vector<Level> levels_;
+    string path_;
+    string mode_;
+    ObjectId oid_;
+    size_t subtreeEntries_ = 0;
+    const CachedTree *subtreeCache_ = nullptr;
 };
+}
 
-static unordered_map<string, IndexEntry> readIndex() {
-    unordered_map<string, IndexEntry> entries;
-    
-    if (!fs::exists(".mintvcs/index")) {
-        return entries;
-    }
-    
-    ifstream indexFile(".mintvcs/index");
-    string line;
-    
-    while (getline(indexFile, line)) {
-        if (line.empty()) continue;
-        
-        istringstream ss(line);
-        IndexEntry entry;
-        
-        if (ss >> entry.mode >> entry.type >> entry.oid) {
-            getline(ss, entry.path);
-            entry.path = trim(entry.path);
-            if (!entry.path.empty()) {
-                entries[entry.path] = entry;
-            }
-        }
-    }
-    
-    return entries;
+static bool cacheMatches(const CachedTree *cache, const ObjectId &treeOid) {
+    return cache && cache->valid() && cache->entryCount > 0 && cache->oid == treeOid;
 }
 
-static unordered_set<string> readIgnoreList() {
-    unordered_set<string> ignores;
-    ignores.insert(".mintvcs");
-    ignores.insert(".mintvcsignore");
-    
-    ifstream file(".mintvcsignore");
-    if (!file.is_open()) {
-        return ignores;
-    }
-    
-    string line;
-    while (getline(file, line)) {
-        line = trim(line);
-        if (line.empty() || line[0] == '#') continue;
-        
-        replace(line.begin(), line.end(), '\\', '/');
-        if (!line.empty() && line.back() == '/') {
-            line.pop_back();
-        }
-        
-        ignores.insert(line);
-    }
-    
-    return ignores;
+// Index order compares whole paths, so a directory sorts as its name plus '/'
+static bool treeEntryLess(const TreeEntry &a, const TreeEntry &b) {
+    size_t common = min(a.name.size(), b.name.size());
+    int cmp = a.name.compare(0, common, b.name, 0, common);
+    if (cmp != 0) return cmp < 0;
+    auto charAt = [](const TreeEntry &e, size_t i) -> int {
+        return i < e.name.size() ? static_cast<unsigned char>(e.name[i]) : (e.isDir ? '/' : -1);
+    };
+    return charAt(a, common) < charAt(b, common);
 }
 
-static bool isIgnored(const fs::path &relativePath, const unordered_set<string> &ignores) {
-    string relStr = relativePath.generic_string();
-    
-    string firstComponent;
-    size_t slashPos = relStr.find('/');
-    if (slashPos != string::npos) {
-        firstComponent = relStr.substr(0, slashPos);
-    } else {
-        firstComponent = relStr;
-    }
-    
-    if (ignores.count(firstComponent)) {
-        return true;
-    }
-    if (ignores.count(relStr)) {
-        return true;
+HeadFiles::HeadFiles(const ObjectId &root, const CachedTree *cache) {
+    if (root.is_null()) return;
+    if (cacheMatches(cache, root)) {
+        oid_ = root;
+        subtreeEntries_ = size_t(cache->entryCount);
+        subtreeCache_ = cache;
+        return;
     }
-    
-    return false;
+    push(root, "", cache);
+    settle();
 }
 
-static void collectWorkingFiles(const fs::path &dir, 
-                                unordered_set<string> &files,
-                                const unordered_set<string> &ignores,
-                                const fs::path &root) {
-    for (const auto &entry : fs::directory_iterator(dir)) {
-        fs::path relativePath = fs::relative(entry.path(), root);
-        
-        if (isIgnored(relativePath, ignores)) {
+void HeadFiles::push(const ObjectId &treeOid, string prefix, const CachedTree *cache) {
+    Level level;
+    level.prefix = std::move(prefix);
+    level.cache = cache;
+    // an unreadable tree counts as empty, as an unreadable HEAD does
+    try {
+        ObjectRef tree = object_store_get(treeOid, "tree");
+        tree_for_each_entry(tree->body(), [&](const TreeEntryView &view) {
+            level.entries.push_back(TreeEntry{ string(view.name), string(view.mode), view.oid, view.isDir() });
+        });
+    } catch (...) {
+        level.entries.clear();
+    }
+    if (!is_sorted(level.entries.begin(), level.entries.end(), treeEntryLess))
+        sort(level.entries.begin(), level.entries.end(), treeEntryLess);
+    levels_.push_back(std::move(level));
+}
+
+void HeadFiles::settle() {
+    while (!levels_.empty()) {
+        Level &level = levels_.back();
+        if (level.next == level.entries.size()) {
+            levels_.pop_back();
             continue;
         }
-        
-        if (entry.is_directory()) {
-            collectWorkingFiles(entry.path(), files, ignores, root);
-        } else if (entry.is_regular_file()) {
-            files.insert(relativePath.generic_string());
+        const TreeEntry &entry = level.entries[level.next++];
+        path_ = level.prefix + entry.name;
+        mode_ = entry.mode;
+        oid_ = entry.oid;
+        if (!entry.isDir) return;
+
+        const CachedTree *cache = level.cache ? level.cache->child(entry.name) : nullptr;
+        if (cacheMatches(cache, oid_)) {
+            subtreeEntries_ = size_t(cache->entryCount);
+            subtreeCache_ = cache;
+            return;
         }
+        push(oid_, path_ + "/", cache);
     }
 }
 
-void mintvcs_status() {
-    if (!fs::exists(".mintvcs")) {
-        cerr << "Not a mintvcs repository\n";
-        return;
-    }
-    
-    string branch = getCurrentBranch();
-    cout << "On branch " << branch << "\n\n";
-    
-    string commitOid = resolveHeadToCommit();
-    unordered_map<string, string> commitFiles;
-    
-    if (!commitOid.empty()) {
-        try {
-            string treeOid = getTreeFromCommit(commitOid);
-            collectCommitFiles(treeOid, commitFiles);
-        } catch (...) {
+void HeadFiles::next() {
+    subtreeEntries_ = 0;
+    settle();
+}
+
+void HeadFiles::descend() {
+    subtreeEntries_ = 0;
+    push(oid_, path_.empty() ? "" : path_ + "/", subtreeCache_);
+    // the subtree itself matched; its children are looked up afresh
+    levels_.back().cache = nullptr;
+    settle();
+}
+
+// .mintvcsignore plus the repository's own files
+static vector<string> readIgnoreRules() {
+    vector<string> rules = { "/.mintvcs", "/.mintvcsignore" };
+    vector<string> fileRules = ignore_read_rules(".mintvcsignore");
+    rules.insert(rules.end(), fileRules.begin(), fileRules.end());
+    return rules;
+}
+
+// One line under "Changes to be committed"
+struct StagedChange {
+    string path;
+    const char *label;
+};
+
+// What the verify phase found for one index entry
+enum class WorkState : uint8_t { Missing, Clean, Refreshed, Modified };
+
+// Index entries per verify job: enough to amortise the job, few enough that
+// idle workers can steal the tail of a skewed range
+static const size_t VERIFY_BATCH = 64;
+
+namespace {
+// Which verify batches are done, so the report can follow right behind the
+// workers instead of waiting for all of them
+class BatchProgress {
+public:
+    explicit BatchProgress(size_t batches) : done_(batches, false) {}
+
+    void finish(size_t batch) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            done_[batch] = true;
         }
+        ready_.notify_all();
     }
-    
-    auto index = readIndex();
-    auto ignores = readIgnoreList();
-    
-    unordered_set<string> workingFiles;
-    collectWorkingFiles(fs::current_path(), workingFiles, ignores, fs::current_path());
-    
-    vector<string> staged;
-    vector<string> modified;
-    vector<string> deleted;
-    vector<string> untracked;
-    
-    for (const auto &pair : index) {
-        const string &path = pair.first;
-        const IndexEntry &entry = pair.second;
-        
-        bool inCommit = commitFiles.find(path) != commitFiles.end();
-        bool changedFromCommit = !inCommit || commitFiles[path] != entry.oid;
-        
-        if (workingFiles.count(path)) {
-            try {
-                string currentOid = hash_object(path, false);
-                if (currentOid != entry.oid) {
-                    modified.push_back(path);
-                } else if (changedFromCommit) {
-                    staged.push_back(path);
-                }
-            } catch (...) {
-                modified.push_back(path);
-            }
+    bool finished(size_t batch) {
+        lock_guard<mutex> lock(mutex_);
+        return done_[batch];
+    }
+    void wait(size_t batch) {
+        unique_lock<mutex> lock(mutex_);
+        ready_.wait(lock, [&] { return bool(done_[batch]); });
+    }
+
+private:
+    mutex mutex_;
+    condition_variable ready_;
+    vector<bool> done_;
+};
+}
+
+// Compare one entry with its working file. Only touches the entry itself, so
+// entries can be checked from several threads at once.
+static WorkState verifyEntry(const Index &index, IndexEntry &entry, const FsmonitorChanges *changes) {
+    // fsmonitor saw nothing happen to a file that matched: no stat needed
+    if (changes && !changes->covers(entry.path) && !index.fsmonitor().is_dirty(entry.path))
+        return WorkState::Clean;
+    IndexStat current;
+    if (!index_stat_file(entry.path, current)) return WorkState::Missing;
+    // Unchanged stat data means unchanged content: skip the rehash
+    if (index.entry_is_clean(entry, current)) return WorkState::Clean;
+    try {
+        if (hash_object_id(entry.path, false) != entry.oid) return WorkState::Modified;
+    } catch (...) {
+        return WorkState::Modified;
+    }
+    // content matched: record the new stat data for next time
+    entry.stat = current;
+    return WorkState::Refreshed;
+}
+
+// Quoted C-style when a line-oriented reader would trip over the path
+static string quotePath(const string &path) {
+    bool plain = all_of(path.begin(), path.end(), [](char c) {
+        unsigned char u = static_cast<unsigned char>(c);
+        return u >= 0x20 && u != 0x7f && c != '"' && c != '\\';
+    });
+    if (plain) return path;
+    string out = "\"";
+    for (char c : path) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (u < 0x20 || u == 0x7f) {
+            char octal[5];
+            snprintf(octal, sizeof(octal), "\\%03o", u);
+            out += octal;
         } else {
-            if (changedFromCommit) {
-                staged.push_back(path);
-            }
-            deleted.push_back(path);
+            out += c;
         }
     }
-    
-    for (const string &path : workingFiles) {
-        if (index.find(path) == index.end()) {
-            untracked.push_back(path);
-        }
+    out += '"';
+    return out;
+}
+
+static void printPath(const StatusOptions &options, const string &path) {
+    cout << (options.nulTerminated ? path : quotePath(path)) << (options.nulTerminated ? '\0' : '\n');
+}
+
+// One record of the short and porcelain formats. staged compares HEAD with
+// the index and unstaged the index with the working file: 'A', 'M', 'D' or
+// ' ' for no change. headOid is null for a path not in HEAD, entry for one
+// not in the index.
+static void printRecord(const StatusOptions &options, char staged, char unstaged, const string &path,
+                        const string *headMode, const ObjectId *headOid, const IndexEntry *entry) {
+    if (options.format == StatusFormat::PorcelainV2) {
+        static const string noMode = "000000";
+        static const ObjectId noOid;
+        cout << "1 " << (staged == ' ' ? '.' : staged) << (unstaged == ' ' ? '.' : unstaged) << " N... "
+             << (headOid ? *headMode : noMode) << ' ' << (entry ? entry->mode : noMode) << ' '
+             << (entry && unstaged != 'D' ? entry->mode : noMode) << ' ' << (headOid ? *headOid : noOid).hex()
+             << ' ' << (entry ? entry->oid : noOid).hex() << ' ';
+    } else {
+        cout << staged << unstaged << ' ';
     }
-    
-    sort(staged.begin(), staged.end());
-    sort(modified.begin(), modified.end());
-    sort(deleted.begin(), deleted.end());
-    sort(untracked.begin(), untracked.end());
-    
+    printPath(options, path);
+}
+
+// The sections for people, once everything has been classified
+static void printLongFormat(const vector<StagedChange> &staged, const vector<string> &modified,
+                            const vector<string> &deleted, const vector<string> &untracked) {
     if (!staged.empty()) {
         cout << "Changes to be committed:\n";
         cout << "  (use \"mintvcs reset <file>...\" to unstage)\n\n";
-        for (const auto &file : staged) {
-            bool inCommit = commitFiles.find(file) != commitFiles.end();
-            if (inCommit) {
-                cout << "\tmodified:   " << file << "\n";
-            } else {
-                cout << "\tnew file:   " << file << "\n";
-            }
+        for (const StagedChange &change : staged) {
+            cout << "\t" << change.label << change.path << "\n";
         }
         cout << "\n";
     }
@@ -419,4 +425,204 @@ void mintvcs_status() {
     if (staged.empty() && modified.empty() && deleted.empty() && untracked.empty()) {
         cout << "nothing to commit, working tree clean\n";
     }
+}
+
+static double elapsedMs(chrono::steady_clock::time_point &since) {
+    auto now = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(now - since).count();
+    since = now;
+    return ms;
+}
+
+void mintvcs_status(const StatusOptions &options) {
+    if (!fs::exists(".mintvcs")) {
+        cerr << "Not a mintvcs repository\n";
+        return;
+    }
+    
+    auto phaseStart = chrono::steady_clock::now();
+    unsigned threads = resolve_job_count(options.jobs);
+    // The short and porcelain formats print each path as soon as it is
+    // classified; only the long format collects them into sections
+    bool streaming = options.format != StatusFormat::Long;
+    
+    if (!streaming) {
+        string branch = getCurrentBranch();
+        cout << "On branch " << branch << "\n\n";
+    }
+    
+    ObjectId headTree;
+    string commitOid = resolveHeadToCommit();
+    if (!commitOid.empty()) {
+        try {
+            headTree = ObjectId::from_hex(getTreeFromCommit(commitOid));
+        } catch (...) {
+        }
+    }
+    
+    Index index;
+    index.load();
+    // Asked before anything is looked at, so changes made during this run
+    // are reported to the next one
+    FsmonitorChanges fsmonitorChanges;
+    const FsmonitorChanges *changes =
+        fsmonitor_query(index.fsmonitor().token, fsmonitorChanges) ? &fsmonitorChanges : nullptr;
+    double readMs = elapsedMs(phaseStart);
+    
+    WorkPool pool(threads);
+    bool indexRefreshed = false;
+    
+    // Verify phase: every job owns a disjoint slice of the index and of
+    // states, so results need no locking
+    vector<WorkState> states(index.size());
+    auto entries = index.begin();
+    BatchProgress progress((index.size() + VERIFY_BATCH - 1) / VERIFY_BATCH);
+    for (size_t begin = 0; begin < index.size(); begin += VERIFY_BATCH) {
+        size_t end = min(index.size(), begin + VERIFY_BATCH);
+        pool.submit([&index, entries, begin, end, &states, changes, &progress] {
+            try {
+                for (size_t i = begin; i < end; ++i) states[i] = verifyEntry(index, entries[i], changes);
+            } catch (...) {
+                progress.finish(begin / VERIFY_BATCH);
+                throw;
+            }
+            progress.finish(begin / VERIFY_BATCH);
+        });
+    }
+    
+    // Report phase, while the workers are still verifying: HEAD's files and
+    // the index, both in path order, are joined in one pass, so every bucket
+    // fills up already sorted and records can be printed straight away
+    vector<StagedChange> staged;
+    vector<string> modified;
+    vector<string> deleted;
+    vector<string> dirty;
+    
+    size_t verified = 0;  // entries below this are known to be checked
+    auto awaitVerified = [&](size_t i) {
+        while (i >= verified) {
+            size_t batch = verified / VERIFY_BATCH;
+            if (!progress.finished(batch)) {
+                // let the reader have what is out so far before blocking
+                cout.flush();
+                progress.wait(batch);
+            }
+            verified = min(index.size(), verified + VERIFY_BATCH);
+        }
+    };
+    
+    // headOid is null for an entry HEAD does not have
+    auto report = [&](size_t i, const string *headMode, const ObjectId *headOid) {
+        awaitVerified(i);
+        const IndexEntry &entry = entries[i];
+        WorkState state = states[i];
+        if (state == WorkState::Refreshed) indexRefreshed = true;
+        char stagedCode = !headOid ? 'A' : *headOid != entry.oid ? 'M' : ' ';
+        char unstagedCode = state == WorkState::Modified ? 'M' : state == WorkState::Missing ? 'D' : ' ';
+        if (unstagedCode != ' ') dirty.push_back(entry.path);
+        if (streaming) {
+            if (stagedCode != ' ' || unstagedCode != ' ')
+                printRecord(options, stagedCode, unstagedCode, entry.path, headMode, headOid, &entry);
+            return;
+        }
+        if (state == WorkState::Modified) {
+            modified.push_back(entry.path);
+        } else if (stagedCode != ' ') {
+            staged.push_back(StagedChange{ entry.path, headOid ? "modified:   " : "new file:   " });
+        }
+        if (state == WorkState::Missing) deleted.push_back(entry.path);
+    };
+    
+    HeadFiles head(headTree, &index.cache_tree());
+    size_t position = 0;
+    while (!head.done() || position < index.size()) {
+        if (head.atSubtree()) {
+            // A subtree the index's cached tree vouches for: its entries all
+            // match HEAD, and its tree objects are never read
+            string prefix = head.path().empty() ? "" : head.path() + "/";
+            if (position < index.size() && entries[position].path < prefix) {
+                report(position, nullptr, nullptr);
+                ++position;
+            } else if (index_range_is_dir(index.entries(), position, head.subtreeEntries(), head.path())) {
+                for (size_t end = position + head.subtreeEntries(); position < end; ++position)
+                    report(position, &entries[position].mode, &entries[position].oid);
+                head.next();
+            } else {
+                head.descend();
+            }
+            continue;
+        }
+        
+        int order = head.done() ? 1 : position == index.size() ? -1 : head.path().compare(entries[position].path);
+        if (order < 0) {
+            // in HEAD, gone from the index
+            if (streaming) {
+                printRecord(options, 'D', ' ', head.path(), &head.mode(), &head.oid(), nullptr);
+            } else {
+                staged.push_back(StagedChange{ head.path(), "deleted:    " });
+            }
+            head.next();
+            continue;
+        }
+        if (order == 0) {
+            report(position, &head.mode(), &head.oid());
+            head.next();
+        } else {
+            report(position, nullptr, nullptr);
+        }
+        ++position;
+    }
+    pool.wait();
+    double verifyMs = elapsedMs(phaseStart);
+    
+    // Untracked phase
+    vector<string> untracked;
+    if (options.untracked) {
+        vector<string> rules = readIgnoreRules();
+        IgnoreMatcher ignores(rules);
+        UntrackedCache scratch;
+        UntrackedCache &cache = config_get_bool("core.untrackedCache", true) ? index.untracked_cache() : scratch;
+        bool cacheUpdated = false;
+        untracked = find_untracked(cache, untracked_rules_id(rules), index, ignores, changes, pool, cacheUpdated);
+        if (&cache == &scratch && index.untracked_cache().present) {
+            index.untracked_cache() = UntrackedCache();
+            indexRefreshed = true;
+        }
+        if (cacheUpdated && &cache != &scratch) indexRefreshed = true;
+    }
+    sort(untracked.begin(), untracked.end());
+    if (streaming) {
+        for (const string &file : untracked) {
+            cout << (options.format == StatusFormat::PorcelainV2 ? "? " : "?? ");
+            printPath(options, file);
+        }
+        cout.flush();
+    }
+    double untrackedMs = elapsedMs(phaseStart);
+    
+    // Every entry has been checked: record where the index stands against
+    // the daemon, or forget a token when there is no daemon to ask
+    IndexFsmonitor &fsmonitor = index.fsmonitor();
+    if (fsmonitorChanges.token.empty()) dirty.clear();
+    if (fsmonitor.token != fsmonitorChanges.token || fsmonitor.dirty != dirty) {
+        fsmonitor.token = fsmonitorChanges.token;
+        fsmonitor.dirty = std::move(dirty);
+        indexRefreshed = true;
+    }
+    
+    // Best effort: a read-only repository still gets a status
+    if (indexRefreshed) {
+        try {
+            index.save();
+        } catch (...) {
+        }
+    }
+    
+    if (!streaming) printLongFormat(staged, modified, deleted, untracked);
+
+    if (options.timings) {
+        double reportMs = elapsedMs(phaseStart);
+        cerr << "status: read " << readMs << " ms, verify " << verifyMs << " ms, untracked " << untrackedMs
+             << " ms, report " << reportMs << " ms (" << threads << " threads)\n";
+    }
 }
\ No newline at end of file
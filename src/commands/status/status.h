@@ -1,6 +1,26 @@
 #ifndef STATUS_H
 #define STATUS_H
 
-void mintvcs_status();
+enum class StatusFormat {
+    Long,         // sections for people, collected and sorted
+    Short,        // "XY path", one line per changed path
+    Porcelain,    // as Short, but kept stable for scripts
+    PorcelainV2,  // "1 XY ..." records with modes and OIDs
+};
+
+struct StatusOptions {
+    // Files are checked on this many worker threads (0 = core.jobs / number
+    // of cores)
+    int jobs = 0;
+    // Report per-phase times on stderr
+    bool timings = false;
+    // -uno turns this off: no untracked files are looked for or shown
+    bool untracked = true;
+    StatusFormat format = StatusFormat::Long;
+    // -z: records end in NUL and paths are never quoted
+    bool nulTerminated = false;
+};
+
+void mintvcs_status(const StatusOptions &options = StatusOptions());
 
 #endif
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "untracked_cache.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../hash_object/sha1.h"
+#include "../walk/walk.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Coarsest directory mtime granularity we allow for, as for index entries
+static const uint64_t RACY_MARGIN_NS = 2000000000ULL;
+
+ObjectId untracked_rules_id(const vector<string> &rules) {
+    SHA1_CTX ctx;
+    sha1_init(ctx);
+    for (const string &rule : rules) {
+        sha1_update(ctx, reinterpret_cast<const uint8_t*>(rule.data()), rule.size());
+        sha1_update(ctx, reinterpret_cast<const uint8_t*>("\n"), 1);
+    }
+    ObjectId id;
+    sha1_final(ctx, id.bytes);
+    return id;
+}
+
+static bool stat_dir(const string &path, IndexStat &out) {
+    out = IndexStat();
+#ifdef _WIN32
+    error_code ec;
+    auto mtime = fs::last_write_time(path.empty() ? "." : path, ec);
+    if (ec) return false;
+    auto ns = chrono::duration_cast<chrono::nanoseconds>(mtime.time_since_epoch()).count();
+    out.mtimeSec = uint32_t(ns / 1000000000);
+    out.mtimeNsec = uint32_t(ns % 1000000000);
+    return true;
+#else
+    struct stat st;
+    if (stat(path.empty() ? "." : path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) return false;
+    out.ctimeSec = uint32_t(st.st_ctim.tv_sec);
+    out.ctimeNsec = uint32_t(st.st_ctim.tv_nsec);
+    out.mtimeSec = uint32_t(st.st_mtim.tv_sec);
+    out.mtimeNsec = uint32_t(st.st_mtim.tv_nsec);
+    out.dev = uint64_t(st.st_dev);
+    out.ino = uint64_t(st.st_ino);
+    return true;
+#endif
+}
+
+static bool same_dir_stat(const IndexStat &a, const IndexStat &b) {
+    return a.mtimeSec == b.mtimeSec && a.mtimeNsec == b.mtimeNsec && a.ctimeSec == b.ctimeSec &&
+           a.ctimeNsec == b.ctimeNsec && a.ino == b.ino && a.dev == b.dev;
+}
+
+static uint64_t mtime_ns(const IndexStat &st) {
+    return uint64_t(st.mtimeSec) * 1000000000ULL + st.mtimeNsec;
+}
+
+static string join_path(const string &dir, const string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+namespace {
+
+// One scan over the cache. Each directory is a job that only writes its own
+// node and then hands its children to jobs of their own.
+struct UntrackedScan {
+    const Index &index;
+    const IgnoreMatcher &ignores;
+    const FsmonitorChanges *changes;
+    WorkPool &pool;
+    unordered_set<string> changedDirs;  // directories fsmonitor saw an entry change in
+    uint64_t startNs = 0;
+    atomic<bool> updated{ false };
+
+    UntrackedScan(const Index &index, const IgnoreMatcher &ignores, const FsmonitorChanges *changes,
+                  WorkPool &pool)
+        : index(index), ignores(ignores), changes(changes), pool(pool) {}
+
+    bool unchanged(const UntrackedDir &dir, const string &path) const;
+    void relist(UntrackedDir &dir, const string &path);
+    void scan(UntrackedDir &dir, const string &path);
+};
+
+}
+
+bool UntrackedScan::unchanged(const UntrackedDir &dir, const string &path) const {
+    if (!dir.listed) return false;
+    if (changes) return !changes->covers(path) && !changedDirs.count(path);
+    IndexStat now;
+    return stat_dir(path, now) && same_dir_stat(now, dir.stat);
+}
+
+void UntrackedScan::relist(UntrackedDir &dir, const string &path) {
+    updated = true;
+    vector<UntrackedDir> oldChildren = std::move(dir.children);
+    dir.children.clear();
+    dir.files.clear();
+
+    // stat before listing: a change made during the listing then shows up as
+    // a different mtime next time
+    vector<string> files, dirs;
+    if (!stat_dir(path, dir.stat) || !walk_list_dir(path, files, dirs)) {
+        dir.listed = false;
+        return;
+    }
+    // changed in the same tick as the stat, it would look unchanged
+    dir.listed = mtime_ns(dir.stat) + RACY_MARGIN_NS < startNs;
+
+    for (string &name : files) {
+        string filePath = join_path(path, name);
+        if (!ignores.matches(filePath, false) && !index.find(filePath)) dir.files.push_back(std::move(name));
+    }
+
+    unordered_map<string, size_t> byName;
+    for (size_t i = 0; i < oldChildren.size(); ++i) byName.emplace(oldChildren[i].name, i);
+    for (string &name : dirs) {
+        if (ignores.matches(join_path(path, name), true)) continue;
+        auto old = byName.find(name);
+        if (old != byName.end()) {
+            dir.children.push_back(std::move(oldChildren[old->second]));
+        } else {
+            dir.children.emplace_back();
+            dir.children.back().name = std::move(name);
+        }
+    }
+}
+
+void UntrackedScan::scan(UntrackedDir &dir, const string &path) {
+    if (!unchanged(dir, path)) relist(dir, path);
+    // children is final now, so the jobs' node pointers stay valid
+    for (UntrackedDir &child : dir.children) {
+        UntrackedDir *node = &child;
+        string childPath = join_path(path, child.name);
+        pool.submit([this, node, childPath] { scan(*node, childPath); });
+    }
+}
+
+static void collect(const UntrackedDir &dir, const string &path, const Index &index, vector<string> &out) {
+    for (const string &name : dir.files) {
+        // added to the index since the listing
+        string filePath = join_path(path, name);
+        if (!index.find(filePath)) out.push_back(std::move(filePath));
+    }
+    for (const UntrackedDir &child : dir.children) collect(child, join_path(path, child.name), index, out);
+}
+
+vector<string> find_untracked(UntrackedCache &cache, const ObjectId &rulesId, const Index &index,
+                              const IgnoreMatcher &ignores, const FsmonitorChanges *changes, WorkPool &pool,
+                              bool &updated) {
+    updated = false;
+    if (!cache.present || cache.rulesId != rulesId) {
+        cache = UntrackedCache();
+        cache.present = true;
+        cache.rulesId = rulesId;
+        updated = true;
+    }
+    // changes are relative to the index's token; a status that skipped
+    // untracked files may have moved that past the cache's, and whatever
+    // happened in between is then only in the directories' stat data
+    string token = changes ? changes->token : string();
+    if (cache.token.empty() || cache.token != index.fsmonitor().token) changes = nullptr;
+
+    UntrackedScan scan(index, ignores, changes, pool);
+    auto now = chrono::system_clock::now().time_since_epoch();
+    scan.startNs = uint64_t(chrono::duration_cast<chrono::nanoseconds>(now).count());
+    if (changes) {
+        for (const string &path : changes->paths) {
+            size_t slash = path.rfind('/');
+            scan.changedDirs.insert(slash == string::npos ? "" : path.substr(0, slash));
+        }
+    }
+    pool.submit([&] { scan.scan(cache.root, ""); });
+    pool.wait();
+    if (scan.updated) updated = true;
+    if (cache.token != token) {
+        cache.token = std::move(token);
+        updated = true;
+    }
+
+    vector<string> untracked;
+    collect(cache.root, "", index, untracked);
+    return untracked;
+}
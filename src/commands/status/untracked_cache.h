@@ -0,0 +1,28 @@
+#ifndef UNTRACKED_CACHE_H
+#define UNTRACKED_CACHE_H
+
+#include <string>
+#include <vector>
+
+#include "../fsmonitor/fsmonitor.h"
+#include "../hash_object/work_pool.h"
+#include "../ignore/ignore.h"
+#include "../index/index.h"
+
+// Identifies a set of ignore rules; a cache built under other rules is dropped
+ObjectId untracked_rules_id(const std::vector<std::string> &rules);
+
+// The untracked files of the working tree, found through cache: a directory
+// whose stat data has not changed since it was last listed is not listed
+// again, and with fsmonitor changes a directory the daemon saw nothing happen
+// in is not even stat'ed. The changes are only trusted when the cache was
+// last checked at the index's fsmonitor token. Directories are scanned as
+// jobs on pool.
+//
+// The cache is updated in place; updated is set when it changed and should
+// be saved. The paths come back in no particular order.
+std::vector<std::string> find_untracked(UntrackedCache &cache, const ObjectId &rulesId, const Index &index,
+                                        const IgnoreMatcher &ignores, const FsmonitorChanges *changes,
+                                        WorkPool &pool, bool &updated);
+
+#endif
@@ -0,0 +1,252 @@
+#include "walk.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#include "../hash_object/work_pool.h"
+
+#ifdef _WIN32
+#include <filesystem>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#endif
+
+using namespace std;
+
+static void append_name(string &path, const char *name) {
+    if (!path.empty()) path += '/';
+    path += name;
+}
+
+#ifndef _WIN32
+
+enum class EntryKind { Dir, File, Other };
+
+static bool is_dot_or_dotdot(const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+// d_type when the filesystem reports it, else a stat that follows symlinks
+static EntryKind entry_kind(int dirFd, const char *name, unsigned char type) {
+    if (type == DT_DIR) return EntryKind::Dir;
+    if (type == DT_REG) return EntryKind::File;
+    if (type != DT_UNKNOWN && type != DT_LNK) return EntryKind::Other;
+
+    struct stat st;
+    if (fstatat(dirFd, name, &st, 0) != 0) return EntryKind::Other;
+    if (S_ISDIR(st.st_mode)) return EntryKind::Dir;
+    if (S_ISREG(st.st_mode)) return EntryKind::File;
+    return EntryKind::Other;
+}
+
+// Call fn(name, kind) for every entry of an open directory but . and ..
+template <typename Fn>
+static void for_each_entry(int fd, Fn &&fn) {
+#ifdef __linux__
+    // linux_dirent64: ino u64 | off s64 | reclen u16 | type u8 | name, NUL-terminated
+    vector<char> buffer(32 * 1024);
+    while (true) {
+        long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n <= 0) break;
+        for (long offset = 0; offset < n;) {
+            const char *record = buffer.data() + offset;
+            uint16_t recordLen;
+            memcpy(&recordLen, record + 16, sizeof(recordLen));
+            offset += recordLen;
+            const char *name = record + 19;
+            if (is_dot_or_dotdot(name)) continue;
+            fn(name, entry_kind(fd, name, static_cast<unsigned char>(record[18])));
+        }
+    }
+#else
+    int own = dup(fd);
+    if (own < 0) return;
+    DIR *dir = fdopendir(own);
+    if (!dir) {
+        close(own);
+        return;
+    }
+    while (dirent *entry = readdir(dir)) {
+        if (is_dot_or_dotdot(entry->d_name)) continue;
+        fn(entry->d_name, entry_kind(fd, entry->d_name, entry->d_type));
+    }
+    closedir(dir);
+#endif
+}
+
+static int open_dir_at(int parentFd, const char *name) {
+    return openat(parentFd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+static int open_root(const string &dir) {
+    int fd = open_dir_at(AT_FDCWD, dir.empty() ? "." : dir.c_str());
+    if (fd < 0) throw runtime_error("Cannot open directory: " + dir);
+    return fd;
+}
+
+static void walk_fd(int fd, string &path, const WalkIgnore &ignore, const WalkVisit &visit) {
+    for_each_entry(fd, [&](const char *name, EntryKind kind) {
+        if (kind == EntryKind::Other) return;
+        size_t parentLen = path.size();
+        append_name(path, name);
+        if (!ignore(path, kind == EntryKind::Dir)) {
+            if (kind == EntryKind::File) {
+                visit(path);
+            } else {
+                int sub = open_dir_at(fd, name);
+                if (sub >= 0) {
+                    walk_fd(sub, path, ignore, visit);
+                    close(sub);
+                }
+            }
+        }
+        path.resize(parentLen);
+    });
+}
+
+void walk_files(const string &dir, const string &prefix, const WalkIgnore &ignore, const WalkVisit &visit) {
+    int fd = open_root(dir);
+    string path = prefix;
+    try {
+        walk_fd(fd, path, ignore, visit);
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+bool walk_list_dir(const string &dir, vector<string> &files, vector<string> &dirs) {
+    int fd = open_dir_at(AT_FDCWD, dir.empty() ? "." : dir.c_str());
+    if (fd < 0) return false;
+    for_each_entry(fd, [&](const char *name, EntryKind kind) {
+        if (kind == EntryKind::File) files.emplace_back(name);
+        else if (kind == EntryKind::Dir) dirs.emplace_back(name);
+    });
+    close(fd);
+    return true;
+}
+
+namespace {
+
+// One directory's entries in directory order: files, and the listings of
+// subdirectories that are read by jobs of their own
+struct DirListing {
+    struct Item {
+        string file;
+        unique_ptr<DirListing> dir;
+    };
+    vector<Item> items;
+};
+
+}
+
+static void flatten(DirListing &listing, vector<string> &out) {
+    for (DirListing::Item &item : listing.items) {
+        if (item.dir) flatten(*item.dir, out);
+        else out.push_back(std::move(item.file));
+    }
+}
+
+// Read one directory, named by its path below the walk's root descriptor,
+// and hand each subdirectory to a new job
+static void list_dir(int rootFd, const string &below, const string &path, DirListing *listing,
+                     WorkPool &pool, const WalkIgnore &ignore) {
+    int fd = open_dir_at(rootFd, below.empty() ? "." : below.c_str());
+    if (fd < 0) return;
+    for_each_entry(fd, [&](const char *name, EntryKind kind) {
+        if (kind == EntryKind::Other) return;
+        string childPath = path;
+        append_name(childPath, name);
+        if (ignore(childPath, kind == EntryKind::Dir)) return;
+
+        listing->items.emplace_back();
+        if (kind == EntryKind::File) {
+            listing->items.back().file = std::move(childPath);
+            return;
+        }
+        listing->items.back().dir.reset(new DirListing());
+        DirListing *child = listing->items.back().dir.get();
+        string childBelow = below;
+        append_name(childBelow, name);
+        pool.submit([rootFd, childBelow, childPath, child, &pool, &ignore] {
+            list_dir(rootFd, childBelow, childPath, child, pool, ignore);
+        });
+    });
+    close(fd);
+}
+
+vector<string> walk_files_parallel(const string &dir, const string &prefix, const WalkIgnore &ignore,
+                                   unsigned threads) {
+    vector<string> files;
+    if (threads <= 1) {
+        walk_files(dir, prefix, ignore, [&](string_view path) { files.emplace_back(path); });
+        return files;
+    }
+
+    int rootFd = open_root(dir);
+    DirListing root;
+    try {
+        WorkPool pool(threads);
+        pool.submit([&] { list_dir(rootFd, "", prefix, &root, pool, ignore); });
+        pool.wait();
+    } catch (...) {
+        close(rootFd);
+        throw;
+    }
+    close(rootFd);
+    flatten(root, files);
+    return files;
+}
+
+#else
+
+namespace fs = std::filesystem;
+
+static void walk_path(const fs::path &dir, string &path, const WalkIgnore &ignore, const WalkVisit &visit) {
+    error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        bool isDir = entry.is_directory(ec);
+        if (!isDir && !entry.is_regular_file(ec)) continue;
+        size_t parentLen = path.size();
+        append_name(path, entry.path().filename().string().c_str());
+        if (!ignore(path, isDir)) {
+            if (isDir) walk_path(entry.path(), path, ignore, visit);
+            else visit(path);
+        }
+        path.resize(parentLen);
+    }
+}
+
+void walk_files(const string &dir, const string &prefix, const WalkIgnore &ignore, const WalkVisit &visit) {
+    if (!fs::is_directory(dir.empty() ? "." : dir)) throw runtime_error("Cannot open directory: " + dir);
+    string path = prefix;
+    walk_path(dir.empty() ? "." : dir, path, ignore, visit);
+}
+
+bool walk_list_dir(const string &dir, vector<string> &files, vector<string> &dirs) {
+    error_code ec;
+    fs::directory_iterator it(dir.empty() ? "." : dir, ec);
+    if (ec) return false;
+    for (const auto &entry : it) {
+        if (entry.is_directory(ec)) dirs.push_back(entry.path().filename().string());
+        else if (entry.is_regular_file(ec)) files.push_back(entry.path().filename().string());
+    }
+    return true;
+}
+
+vector<string> walk_files_parallel(const string &dir, const string &prefix, const WalkIgnore &ignore,
+                                   unsigned) {
+    vector<string> files;
+    walk_files(dir, prefix, ignore, [&](string_view path) { files.emplace_back(path); });
+    return files;
+}
+
+#endif
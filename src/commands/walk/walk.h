@@ -0,0 +1,36 @@
+#ifndef WALK_H
+#define WALK_H
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Working-tree walker shared by add and status. Directories are read with
+// openat/getdents64 relative to their parent's descriptor; the relative path
+// of the current entry is kept in one buffer that grows and shrinks as the
+// walk descends, so no per-entry path objects or realpath lookups are made.
+//
+// Paths handed to the callbacks are '/'-separated: prefix, then the path
+// below dir. Symlinks are followed, as std::filesystem's is_directory and
+// is_regular_file do. Directories that cannot be opened are skipped.
+
+// Return true to leave an entry out; an ignored directory is not descended into
+using WalkIgnore = std::function<bool(std::string_view path, bool isDir)>;
+using WalkVisit = std::function<void(std::string_view path)>;
+
+// Call visit for every regular file below dir, in directory order
+void walk_files(const std::string &dir, const std::string &prefix, const WalkIgnore &ignore,
+                const WalkVisit &visit);
+
+// The same files in the same order as walk_files, with each subdirectory read
+// as its own job on a pool of the given number of threads. ignore must be
+// safe to call from several threads at once.
+std::vector<std::string> walk_files_parallel(const std::string &dir, const std::string &prefix,
+                                             const WalkIgnore &ignore, unsigned threads);
+
+// The regular files and subdirectories directly in dir, by name, in
+// directory order; false if dir cannot be opened
+bool walk_list_dir(const std::string &dir, std::vector<std::string> &files, std::vector<std::string> &dirs);
+
+#endif
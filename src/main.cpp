@@ -2,6 +2,7 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <cstdlib>
 
 #include "./commands/init/init.h"
 #include "./commands/hash_object/hash_object.h"
@@ -12,6 +13,8 @@
 #include "./commands/branch/branch.h"
 #include "./commands/merge/merge.h"
 #include "./commands/status/status.h"
+#include "./commands/repack/repack.h"
+#include "./commands/fsmonitor/fsmonitor.h"
 
 using namespace std;
 
@@ -26,7 +29,35 @@ int main(int argc, char* argv[]) {
         mintvcs_init();
     }
     else if (strcmp(argv[1], "status") == 0) {
-        mintvcs_status();
+        StatusOptions options;
+        for (int i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                options.jobs = atoi(argv[++i]);
+            } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+                options.jobs = atoi(argv[i] + 2);
+            } else if (strcmp(argv[i], "--timings") == 0) {
+                options.timings = true;
+            } else if (strcmp(argv[i], "-uno") == 0) {
+                options.untracked = false;
+            } else if (strcmp(argv[i], "-unormal") == 0 || strcmp(argv[i], "-u") == 0) {
+                options.untracked = true;
+            } else if (strcmp(argv[i], "--short") == 0 || strcmp(argv[i], "-s") == 0) {
+                options.format = StatusFormat::Short;
+            } else if (strcmp(argv[i], "--porcelain") == 0 || strcmp(argv[i], "--porcelain=v1") == 0) {
+                options.format = StatusFormat::Porcelain;
+            } else if (strcmp(argv[i], "--porcelain=v2") == 0) {
+                options.format = StatusFormat::PorcelainV2;
+            } else if (strcmp(argv[i], "-z") == 0) {
+                options.nulTerminated = true;
+            } else {
+                cout << "Usage: mintvcs status [-j <jobs>] [-uno | -unormal] [--short | --porcelain[=v1|v2]] [-z] "
+                        "[--timings]" << endl;
+                return 1;
+            }
+        }
+        // -z alone asks for the porcelain format
+        if (options.nulTerminated && options.format == StatusFormat::Long) options.format = StatusFormat::Porcelain;
+        mintvcs_status(options);
     }
     else if (strcmp(argv[1], "hash-object") == 0) {
         if (argc > 3 && strcmp(argv[2], "-w") == 0) {
@@ -39,10 +70,17 @@ int main(int argc, char* argv[]) {
     }
     else if (strcmp(argv[1], "add") == 0) {
         vector<string> paths;
+        int jobs = 0;
         for (int i = 2; i < argc; ++i) {
-            paths.push_back(argv[i]);
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                jobs = atoi(argv[++i]);
+            } else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0') {
+                jobs = atoi(argv[i] + 2);
+            } else {
+                paths.push_back(argv[i]);
+            }
         }
-        add(paths);
+        add(paths, jobs);
     }
     else if (strcmp(argv[1], "commit") == 0) {
         // Fixed: properly parse -m flag
@@ -113,6 +151,20 @@ int main(int argc, char* argv[]) {
         }
         return merge_branch(argv[2]);
     }
+    else if (strcmp(argv[1], "repack") == 0) {
+        if (argc > 3 || (argc == 3 && strcmp(argv[2], "-a") != 0)) {
+            cout << "Usage: mintvcs repack [-a]" << endl;
+            return 1;
+        }
+        return mintvcs_repack(argc == 3);
+    }
+    else if (strcmp(argv[1], "fsmonitor") == 0) {
+        if (argc != 3) {
+            cout << "Usage: mintvcs fsmonitor <start|run|stop|status>" << endl;
+            return 1;
+        }
+        return mintvcs_fsmonitor(argv[2]);
+    }
     else {
         cout << "Unknown command: " << argv[1] << endl;
     }